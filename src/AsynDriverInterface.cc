@@ -29,6 +29,7 @@ extern "C" {
 }
 #else
 #include "epicsAssert.h"
+#include "epicsMutex.h"
 #include "epicsTime.h"
 #include "epicsTimer.h"
 #include "iocsh.h"
@@ -101,6 +102,25 @@ readRequest()
 unlock()
     call pasynManager->unblockProcessCallback()
 
+deadline scheduling (not for EPICS 3.13):
+
+Only one client of a port/addr at a time is queued in asynManager for
+the lock or holds the lock. The other lock requests wait in the
+PortState lockQueue, ordered by deadline (protocol variable Deadline).
+Requests without Deadline are due when requested, so they keep their
+order. When the owner unlocks, passLock() picks the next client: the
+highest priority, earliest deadline, but any request with a Deadline
+that is overdue first, so that high priority clients cannot starve it.
+
+poll groups (protocol variable PollGroup, not for EPICS 3.13):
+
+Members of a poll group use one asynUser per port/addr (groupUser)
+for their transactions. When a member unlocks and another member of
+the same group is waiting, passGroupLock() hands the blocked groupUser
+over without unblockProcessCallback() and blockProcessCallback().
+All waiting members of a group are thus polled in one sequence.
+An overdue request of a non-member ends the sequence.
+
 asynchonous input support ("I/O Intr"):
 
 pasynOctet->registerInterruptUser(...,intrCallbackOctet,...) is called
@@ -169,7 +189,7 @@ class AsynDriverInterface : StreamBusInterface
     StreamBuffer inputBuffer;
     const char* outputBuffer;
     size_t outputSize;
-    size_t peeksize;
+    size_t readSize;   // first read of a message, follows message lengths
 #ifdef EPICS_3_13
     WDOG_ID timer;
     CALLBACK timeoutCallback;
@@ -179,6 +199,68 @@ class AsynDriverInterface : StreamBusInterface
 #endif
     asynStatus previousAsynStatus;
 
+    // EOS of a port/addr
+    struct Eos
+    {
+        int len; // -1: not supported
+        char str[16];
+        bool equals(const char* s, size_t l) const
+            { return len == (int)l && memcmp(str, s, l) == 0; }
+        void set(const char* s, size_t l)
+            { len = (int)l; memcpy(str, s, l); str[l] = 0; }
+    };
+    // State of a port/addr, shared by all interfaces using it.
+    // Single device ports have one state for all addresses.
+    // The EOS is read on first use and after a connect exception.
+    // The EOS currently set in the driver is tracked to avoid
+    // get/set/restore calls around every transaction. The original EOS
+    // is restored only when no StreamDevice client waits for the port,
+    // so that other asyn clients see their own settings.
+    struct PortState
+    {
+        PortState* next;
+        StreamBuffer portname;
+        int addr;
+        bool eosKnown;           // inputEos and outputEos are valid
+        bool eosSaved;           // savedInputEos and savedOutputEos are valid
+        Eos savedInputEos;       // as configured for other asyn clients
+        Eos savedOutputEos;
+        Eos inputEos;            // currently set in the driver
+        Eos inputEosRequest;     // terminator that inputEos was set for
+        Eos outputEos;
+        StreamBuffer drainBuffer;
+#ifndef EPICS_3_13
+        // lock scheduling of all clients of this port/addr
+        epicsMutexId lockMutex;
+        AsynDriverInterface* lockOwner; // queued in asyn or holding lock
+        AsynDriverInterface* lockQueue; // waiting, by deadline
+        size_t lockQueueDepth;
+        size_t maxLockQueueDepth;
+        unsigned long locks;
+        unsigned long lateLocks;
+        double lockWait;                // seconds, total
+        double maxLockWait;
+        asynUser* groupUser;            // shared by poll group members
+        bool groupLocked;               // groupUser holds the lock
+        unsigned long groupHandoffs;
+#endif
+    };
+    static PortState* portStates;
+    static const size_t drainSize = 4096;
+    static const size_t minReadSize = 256;
+    PortState* port;
+#ifndef EPICS_3_13
+    AsynDriverInterface* nextLock;
+    epicsTime lockRequestTime;
+    epicsTime lockDeadline;
+    bool hasDeadline;
+    bool lockWaiting;   // in port->lockQueue
+    bool lockFailed;    // queueRequest failed when we got the lock
+    asynUser* ownAsynUser;
+    const char* lockGroup;
+    bool groupDrain;    // aborted lock request still queued on groupUser
+#endif
+
     AsynDriverInterface(Client* client);
     ~AsynDriverInterface();
 
@@ -195,6 +277,7 @@ class AsynDriverInterface : StreamBusInterface
     bool connectRequest(unsigned long connecttimeout_ms);
     bool disconnectRequest();
     void finish();
+    void printStatus(StreamBuffer& buffer);
 
 #ifdef EPICS_3_13
     static void expire(CALLBACK *pcallback);
@@ -209,10 +292,25 @@ class AsynDriverInterface : StreamBusInterface
     void lockHandler();
     void writeHandler();
     void readHandler();
+    void adaptReadSize(size_t length);
     void connectHandler();
     void disconnectHandler();
     bool connectToAsynPort();
     void asynReadHandler(const char *data, size_t numchars, int eomReason);
+    void getEos();
+    void restoreEos();
+    void setOutputEos(const char* streameos);
+    void setInputEos(const char* streameos, size_t streameoslen);
+#ifndef EPICS_3_13
+    void queueLockRequest();
+    void passLock();
+    bool dequeueLock();
+    AsynDriverInterface** overdueLock(const epicsTime& now);
+    bool useGroupUser();
+    void useOwnUser() { pasynUser = ownAsynUser; }
+    void releaseGroupUser();
+    bool passGroupLock();
+#endif
     asynQueuePriority priority() {
         return static_cast<asynQueuePriority>
             (StreamBusInterface::priority());
@@ -279,6 +377,8 @@ public:
 
 RegisterStreamBusInterface(AsynDriverInterface);
 
+AsynDriverInterface::PortState* AsynDriverInterface::portStates = NULL;
+
 AsynDriverInterface::
 AsynDriverInterface(Client* client) : StreamBusInterface(client)
 {
@@ -291,16 +391,28 @@ AsynDriverInterface(Client* client) : StreamBusInterface(client)
     pasynUInt32 = NULL;
     intrPvtUInt32 = NULL;
     pasynGpib = NULL;
+    port = NULL;
     connected = 0;
     eventMask = 0;
     receivedEvent = 0;
-    peeksize = 1;
+    readSize = minReadSize;
     previousAsynStatus = asynSuccess;
+#ifndef EPICS_3_13
+    nextLock = NULL;
+    hasDeadline = false;
+    lockWaiting = false;
+    lockFailed = false;
+    lockGroup = NULL;
+    groupDrain = false;
+#endif
     debug ("AsynDriverInterface(%s) createAsynUser\n", client->name());
     pasynUser = pasynManager->createAsynUser(handleRequest,
         handleTimeout);
     assert(pasynUser);
     pasynUser->userPvt = this;
+#ifndef EPICS_3_13
+    ownAsynUser = pasynUser;
+#endif
 #ifdef EPICS_3_13
     debug ("AsynDriverInterface(%s) wdCreate()\n", client->name());
     timer = wdCreate();
@@ -322,6 +434,15 @@ AsynDriverInterface::
 ~AsynDriverInterface()
 {
     cancelTimer();
+#ifndef EPICS_3_13
+    if (pasynUser != ownAsynUser)
+    {
+        // in the middle of a poll group transaction
+        int wasQueued;
+        pasynManager->cancelRequest(pasynUser, &wasQueued);
+        releaseGroupUser();
+    }
+#endif
 
     if (intrPvtInt32)
     {
@@ -348,6 +469,13 @@ AsynDriverInterface::
         // does not return until running handler has finished
     }
     // Now, no handler is running any more and none will start.
+#ifndef EPICS_3_13
+    if (port)
+    {
+        dequeueLock();
+        passLock();
+    }
+#endif
 
 #ifdef EPICS_3_13
     wdDelete(timer);
@@ -484,6 +612,42 @@ connectToBus(const char* portname, int addr)
     pasynOctet = static_cast<asynOctet*>(pasynInterface->pinterface);
     pvtOctet = pasynInterface->drvPvt;
 
+    // all addresses of a single device port share the EOS
+    int multiDevice = 0;
+    pasynManager->isMultiDevice(pasynUser, portname, &multiDevice);
+    if (!multiDevice) addr = -1;
+
+    // find or create shared state of this port/addr
+    for (port = portStates; port; port = port->next)
+    {
+        if (port->addr == addr && strcmp(port->portname(), portname) == 0)
+            break;
+    }
+    if (!port)
+    {
+        port = new PortState;
+        port->portname = portname;
+        port->addr = addr;
+        port->eosKnown = false;
+        port->eosSaved = false;
+#ifndef EPICS_3_13
+        port->lockMutex = epicsMutexMustCreate();
+        port->lockOwner = NULL;
+        port->lockQueue = NULL;
+        port->lockQueueDepth = 0;
+        port->maxLockQueueDepth = 0;
+        port->locks = 0;
+        port->lateLocks = 0;
+        port->lockWait = 0;
+        port->maxLockWait = 0;
+        port->groupUser = NULL;
+        port->groupLocked = false;
+        port->groupHandoffs = 0;
+#endif
+        port->next = portStates;
+        portStates = port;
+    }
+
     // Check if device knows EOS
     size_t streameoslen = 0;
     if (getInTerminator(streameoslen))
@@ -506,9 +670,6 @@ connectToBus(const char* portname, int addr)
     {
         pasynGpib = static_cast<asynGpib*>(pasynInterface->pinterface);
         pvtGpib = pasynInterface->drvPvt;
-        // asynGpib returns overflow error if we try to peek
-        // (read only one byte first).
-        peeksize = inputBuffer.capacity();
     }
 
     // Install callback for connect/disconnect events
@@ -539,6 +700,168 @@ reportAsynStatus(asynStatus status, const char *name)
     }
 }
 
+// read EOS from the driver (called by asynManager)
+void AsynDriverInterface::
+getEos()
+{
+    Eos input, output;
+
+    if (pasynOctet->getInputEos(pvtOctet, pasynUser,
+        input.str, sizeof(input.str)-1, &input.len) != asynSuccess)
+        input.len = -1; // No EOS support?
+    if (pasynOctet->getOutputEos(pvtOctet, pasynUser,
+        output.str, sizeof(output.str)-1, &output.len) != asynSuccess)
+        output.len = -1;
+    port->inputEos = input;
+    port->inputEosRequest = input;
+    port->outputEos = output;
+    port->eosKnown = true;
+    if (!port->eosSaved)
+    {
+        // what other asyn clients have set up
+        port->savedInputEos = input;
+        port->savedOutputEos = output;
+        port->eosSaved = true;
+    }
+    debug2("AsynDriverInterface::getEos(%s) input EOS \"%s\" output EOS \"%s\"\n",
+        clientName(),
+        input.len >= 0 ? StreamBuffer(input.str, input.len).expand()() : "unsupported",
+        output.len >= 0 ? StreamBuffer(output.str, output.len).expand()() : "unsupported");
+}
+
+// The lock is released: give the other asyn clients their EOS back,
+// unless the next StreamDevice client is already waiting for the port.
+void AsynDriverInterface::
+restoreEos()
+{
+    // without known EOS we have not changed anything
+    if (!port->eosSaved || !port->eosKnown) return;
+    if ((port->outputEos.len < 0 || port->outputEos.equals(
+            port->savedOutputEos.str, port->savedOutputEos.len)) &&
+        (port->inputEos.len < 0 || port->inputEos.equals(
+            port->savedInputEos.str, port->savedInputEos.len)))
+        return; // nothing changed
+#ifndef EPICS_3_13
+    bool waiting;
+    epicsMutexMustLock(port->lockMutex);
+    waiting = port->lockQueue != NULL;
+    epicsMutexUnlock(port->lockMutex);
+    if (waiting) return;
+#endif
+    // not called by asynManager
+    if (pasynManager->lockPort(pasynUser) != asynSuccess)
+    {
+        error("%s: warning: cannot restore EOS: %s\n",
+            clientName(), pasynUser->errorMessage);
+        port->eosKnown = false;
+        return;
+    }
+    if (port->outputEos.len >= 0 && !port->outputEos.equals(
+        port->savedOutputEos.str, port->savedOutputEos.len))
+    {
+        debug2("AsynDriverInterface::restoreEos(%s) output EOS \"%s\"\n",
+            clientName(),
+            StreamBuffer(port->savedOutputEos.str,
+                port->savedOutputEos.len).expand()());
+        if (pasynOctet->setOutputEos(pvtOctet, pasynUser,
+            port->savedOutputEos.str, port->savedOutputEos.len)
+            == asynSuccess)
+            port->outputEos = port->savedOutputEos;
+        else
+            port->eosKnown = false;
+    }
+    if (port->inputEos.len >= 0 && !port->inputEos.equals(
+        port->savedInputEos.str, port->savedInputEos.len))
+    {
+        debug2("AsynDriverInterface::restoreEos(%s) input EOS \"%s\"\n",
+            clientName(),
+            StreamBuffer(port->savedInputEos.str,
+                port->savedInputEos.len).expand()());
+        if (pasynOctet->setInputEos(pvtOctet, pasynUser,
+            port->savedInputEos.str, port->savedInputEos.len)
+            == asynSuccess)
+            port->inputEos = port->inputEosRequest = port->savedInputEos;
+        else
+            port->eosKnown = false;
+    }
+    pasynManager->unlockPort(pasynUser);
+}
+
+// Make the driver add the output terminator only if stream has not done so.
+void AsynDriverInterface::
+setOutputEos(const char* streameos)
+{
+    if (!port->eosKnown) getEos();
+    if (port->outputEos.len < 0) return; // No EOS support
+    const char* wanted = "";
+    int wantedlen = 0;
+    if (!streameos) // asyn shall add the terminator set up by the user
+    {
+        wanted = port->savedOutputEos.str;
+        wantedlen = port->savedOutputEos.len;
+        if (wantedlen < 0) return;
+    }
+    if (port->outputEos.equals(wanted, wantedlen)) return;
+    if (pasynOctet->setOutputEos(pvtOctet, pasynUser,
+        wantedlen ? wanted : NULL, wantedlen) == asynSuccess)
+    {
+        debug2("AsynDriverInterface::setOutputEos(%s) "
+            "output EOS changed from \"%s\" to \"%s\"\n",
+            clientName(),
+            StreamBuffer(port->outputEos.str, port->outputEos.len).expand()(),
+            StreamBuffer(wanted, wantedlen).expand()());
+        port->outputEos.set(wanted, wantedlen);
+    }
+    else
+        port->eosKnown = false;
+}
+
+// Set input terminator or restore what the user has set up.
+void AsynDriverInterface::
+setInputEos(const char* streameos, size_t streameoslen)
+{
+    if (!port->eosKnown) getEos();
+    if (port->inputEos.len < 0) return; // No EOS support
+    const char* wanted = streameos;
+    size_t wantedlen = streameoslen;
+    if (!streameos)
+    {
+        if (port->savedInputEos.len < 0) return;
+        wanted = port->savedInputEos.str;
+        wantedlen = port->savedInputEos.len;
+    }
+    if (port->inputEosRequest.equals(wanted, wantedlen))
+    {
+        // nothing to do: already set up for this terminator
+        return;
+    }
+    const char* deveos = wanted;
+    size_t deveoslen = wantedlen;
+    do {
+        // device (e.g. GPIB) might not accept full eos length
+        if (deveoslen < sizeof(port->inputEos.str) &&
+            pasynOctet->setInputEos(pvtOctet, pasynUser,
+                deveos, (int)deveoslen) == asynSuccess)
+        {
+            debug2("AsynDriverInterface::setInputEos(%s) "
+                "input EOS changed from \"%s\" to \"%s\"\n",
+                clientName(),
+                StreamBuffer(port->inputEos.str, port->inputEos.len).expand()(),
+                StreamBuffer(deveos, deveoslen).expand()());
+            port->inputEos.set(deveos, deveoslen);
+            if (wantedlen < sizeof(port->inputEosRequest.str))
+                port->inputEosRequest.set(wanted, wantedlen);
+            else
+                port->inputEosRequest.len = -1;
+            return;
+        }
+        deveos++; deveoslen--;
+    } while (deveoslen);
+    error("%s: warning: pasynOctet->setInputEos() failed: %s\n",
+        clientName(), pasynUser->errorMessage);
+    port->eosKnown = false;
+}
+
 // interface function: we want exclusive access to the device
 // lockTimeout_ms=0 means "block here" (used in @init)
 bool AsynDriverInterface::
@@ -550,12 +873,55 @@ lockRequest(unsigned long lockTimeout_ms)
         clientName(), lockTimeout_ms);
     lockTimeout = lockTimeout_ms ? lockTimeout_ms*0.001 : -1.0;
     ioAction = Lock;
+#ifndef EPICS_3_13
+    AsynDriverInterface** pc;
+    unsigned long deadline_ms = getDeadline();
+
+    // Without a deadline, keep the order of requests.
+    hasDeadline = deadline_ms != 0;
+    lockGroup = getPollGroup();
+    lockRequestTime = epicsTime::getCurrent();
+    lockDeadline = lockRequestTime + deadline_ms*0.001;
+    epicsMutexMustLock(port->lockMutex);
+    if (port->lockOwner)
+    {
+        // same deadline in order of request
+        for (pc = &port->lockQueue; *pc; pc = &(*pc)->nextLock)
+            if (lockDeadline < (*pc)->lockDeadline) break;
+        nextLock = *pc;
+        *pc = this;
+        lockWaiting = true;
+        if (++port->lockQueueDepth > port->maxLockQueueDepth)
+            port->maxLockQueueDepth = port->lockQueueDepth;
+        epicsMutexUnlock(port->lockMutex);
+        debug("AsynDriverInterface::lockRequest(%s): waiting, "
+            "deadline %lu msec\n",
+            clientName(), deadline_ms);
+        if (lockTimeout_ms) startTimer(lockTimeout);
+        return true;
+        // continues with:
+        //    passLock() -> queueLockRequest() -> handleRequest() ...
+        // or timerExpired() -> lockCallback(StreamIoTimeout)
+    }
+    port->lockOwner = this;
+    epicsMutexUnlock(port->lockMutex);
+    if (lockGroup && !useGroupUser())
+    {
+        ioAction = None;
+        passLock();
+        return false;
+    }
+#endif
     status = pasynManager->queueRequest(pasynUser,
         priority(), lockTimeout);
     reportAsynStatus(status, "lockRequest");
     if (status != asynSuccess)
     {
         ioAction = None;
+#ifndef EPICS_3_13
+        releaseGroupUser();
+        passLock();
+#endif
         return false;
     }
     return true;
@@ -564,6 +930,205 @@ lockRequest(unsigned long lockTimeout_ms)
     // or handleTimeout() -> lockCallback(StreamIoTimeout)
 }
 
+#ifndef EPICS_3_13
+// We got the turn from the previous lock owner.
+// Called in the thread of the previous owner.
+void AsynDriverInterface::
+queueLockRequest()
+{
+    asynStatus status;
+    double timeout = lockTimeout;
+
+    cancelTimer();
+    if (timeout > 0)
+    {
+        timeout -= epicsTime::getCurrent() - lockRequestTime;
+        if (timeout < 0.001) timeout = 0.001;
+    }
+    if (lockGroup && !useGroupUser())
+        status = asynError;
+    else
+    {
+        status = pasynManager->queueRequest(pasynUser,
+            priority(), timeout);
+        reportAsynStatus(status, "lockRequest");
+    }
+    if (status != asynSuccess)
+    {
+        // report in our own timer thread
+        lockFailed = true;
+        releaseGroupUser();
+        passLock();
+        startTimer(0);
+    }
+}
+
+// Give up the turn and pass it to the next waiting client.
+void AsynDriverInterface::
+passLock()
+{
+    AsynDriverInterface* next = NULL;
+    AsynDriverInterface** pc;
+    AsynDriverInterface** pnext = NULL;
+    epicsTime now;
+
+    epicsMutexMustLock(port->lockMutex);
+    if (port->lockOwner != this)
+    {
+        epicsMutexUnlock(port->lockMutex);
+        return;
+    }
+    port->lockOwner = NULL;
+    if (port->lockQueue)
+    {
+        // overdue requests first, else highest priority
+        now = epicsTime::getCurrent();
+        pnext = overdueLock(now);
+        if (!pnext)
+        {
+            pnext = &port->lockQueue;
+            for (pc = &port->lockQueue; *pc; pc = &(*pc)->nextLock)
+                if ((*pc)->priority() > (*pnext)->priority()) pnext = pc;
+        }
+        next = *pnext;
+        *pnext = next->nextLock;
+        next->nextLock = NULL;
+        next->lockWaiting = false;
+        port->lockQueueDepth--;
+        port->lockOwner = next;
+    }
+    epicsMutexUnlock(port->lockMutex);
+    if (next)
+    {
+        debug("AsynDriverInterface::passLock(%s): next is %s\n",
+            clientName(), next->clientName());
+        next->queueLockRequest();
+    }
+}
+
+// Find the first waiting request with a Deadline that is overdue.
+// Requests without Deadline are never overdue. Call with lockMutex.
+AsynDriverInterface** AsynDriverInterface::
+overdueLock(const epicsTime& now)
+{
+    AsynDriverInterface** pc;
+
+    for (pc = &port->lockQueue; *pc; pc = &(*pc)->nextLock)
+    {
+        if (!((*pc)->lockDeadline < now)) break; // queue is by deadline
+        if ((*pc)->hasDeadline) return pc;
+    }
+    return NULL;
+}
+
+// Remove from lock queue. Returns false if not waiting.
+bool AsynDriverInterface::
+dequeueLock()
+{
+    AsynDriverInterface** pc;
+    bool waiting;
+
+    epicsMutexMustLock(port->lockMutex);
+    waiting = lockWaiting;
+    if (waiting)
+    {
+        for (pc = &port->lockQueue; *pc; pc = &(*pc)->nextLock)
+        {
+            if (*pc == this)
+            {
+                *pc = nextLock;
+                break;
+            }
+        }
+        nextLock = NULL;
+        lockWaiting = false;
+        port->lockQueueDepth--;
+    }
+    epicsMutexUnlock(port->lockMutex);
+    return waiting;
+}
+
+// Switch to the asynUser shared by all poll group members of the port.
+// Only the lock owner uses it.
+bool AsynDriverInterface::
+useGroupUser()
+{
+    if (!port->groupUser)
+    {
+        asynUser* groupUser = pasynManager->createAsynUser(handleRequest,
+            handleTimeout);
+        asynStatus status = pasynManager->connectDevice(groupUser,
+            port->portname(), port->addr);
+        if (status != asynSuccess)
+        {
+            error("%s: cannot connect poll group to asyn port %s: %s\n",
+                clientName(), port->portname(), groupUser->errorMessage);
+            pasynManager->freeAsynUser(groupUser);
+            return false;
+        }
+        port->groupUser = groupUser;
+    }
+    pasynUser = port->groupUser;
+    pasynUser->userPvt = this;
+    return true;
+}
+
+// Hand the lock to the next waiting member of our poll group.
+// Returns false if there is none or a non-member is overdue.
+bool AsynDriverInterface::
+passGroupLock()
+{
+    AsynDriverInterface* next = NULL;
+    AsynDriverInterface** pc;
+
+    epicsMutexMustLock(port->lockMutex);
+    if (port->lockOwner == this && port->lockQueue && !groupDrain)
+    {
+        pc = overdueLock(epicsTime::getCurrent());
+        if (pc && (!(*pc)->lockGroup ||
+            strcmp((*pc)->lockGroup, lockGroup) != 0))
+        {
+            // a non-member is overdue
+            epicsMutexUnlock(port->lockMutex);
+            return false;
+        }
+        for (pc = &port->lockQueue; *pc; pc = &(*pc)->nextLock)
+        {
+            if ((*pc)->lockGroup && strcmp((*pc)->lockGroup, lockGroup) == 0)
+            {
+                next = *pc;
+                *pc = next->nextLock;
+                next->nextLock = NULL;
+                next->lockWaiting = false;
+                port->lockQueueDepth--;
+                port->lockOwner = next;
+                port->groupHandoffs++;
+                break;
+            }
+        }
+    }
+    epicsMutexUnlock(port->lockMutex);
+    if (!next) return false;
+    debug("AsynDriverInterface::passGroupLock(%s): next is %s\n",
+        clientName(), next->clientName());
+    useOwnUser();
+    next->queueLockRequest();
+    return true;
+}
+
+// Give up the groupUser after a failed or aborted lock request.
+void AsynDriverInterface::
+releaseGroupUser()
+{
+    if (pasynUser == port->groupUser && port->groupLocked)
+    {
+        pasynManager->unblockProcessCallback(pasynUser, false);
+        port->groupLocked = false;
+    }
+    useOwnUser();
+}
+#endif
+
 bool AsynDriverInterface::
 connectToAsynPort()
 {
@@ -590,14 +1155,40 @@ lockHandler()
     debug("AsynDriverInterface::lockHandler(%s)\n",
         clientName());
 
-    status = pasynManager->blockProcessCallback(pasynUser, false);
-    if (status != asynSuccess)
+#ifndef EPICS_3_13
+    if (pasynUser == port->groupUser && port->groupLocked)
     {
-        error("%s lockHandler: pasynManager->blockProcessCallback() failed: %s\n",
-            clientName(), pasynUser->errorMessage);
-        lockCallback(StreamIoFault);
-        return;
+        // handed over by the previous member of our poll group
+        debug("AsynDriverInterface::lockHandler(%s): poll group %s\n",
+            clientName(), lockGroup);
     }
+    else
+#endif
+    {
+        status = pasynManager->blockProcessCallback(pasynUser, false);
+        if (status != asynSuccess)
+        {
+            error("%s lockHandler: pasynManager->blockProcessCallback() failed: %s\n",
+                clientName(), pasynUser->errorMessage);
+#ifndef EPICS_3_13
+            releaseGroupUser();
+            passLock();
+#endif
+            lockCallback(StreamIoFault);
+            return;
+        }
+    }
+#ifndef EPICS_3_13
+    if (pasynUser == port->groupUser) port->groupLocked = true;
+    epicsTime now = epicsTime::getCurrent();
+    double wait = now - lockRequestTime;
+    epicsMutexMustLock(port->lockMutex);
+    port->locks++;
+    port->lockWait += wait;
+    if (wait > port->maxLockWait) port->maxLockWait = wait;
+    if (hasDeadline && lockDeadline < now) port->lateLocks++;
+    epicsMutexUnlock(port->lockMutex);
+#endif
     lockCallback();
 }
 
@@ -609,13 +1200,30 @@ unlock()
 
     debug("AsynDriverInterface::unlock(%s)\n",
         clientName());
+#ifndef EPICS_3_13
+    if (pasynUser == port->groupUser)
+    {
+        // keep the lock for the next member of the poll group
+        if (passGroupLock()) return true;
+        port->groupLocked = false;
+    }
+#endif
+    restoreEos();
     status = pasynManager->unblockProcessCallback(pasynUser, false);
     if (status != asynSuccess)
     {
         error("%s unlock: pasynManager->unblockProcessCallback() failed: %s\n",
             clientName(), pasynUser->errorMessage);
+#ifndef EPICS_3_13
+        useOwnUser();
+        passLock();
+#endif
         return false;
     }
+#ifndef EPICS_3_13
+    useOwnUser();
+    passLock();
+#endif
     return true;
 }
 
@@ -652,7 +1260,13 @@ writeHandler()
     size_t written = 0;
 
     pasynUser->timeout = 0;
-    if (!pasynGpib)
+    if (!flushInput())
+    {
+        // protocol has FlushInput = no: device never sends early input
+        debug("AsynDriverInterface::writeHandler(%s): not flushing input\n",
+            clientName());
+    }
+    else if (!pasynGpib)
     {
         // discard any early input, but forward it to potential async records
         // thus do not use pasynOctet->flush()
@@ -660,16 +1274,18 @@ writeHandler()
         // device as talker when it has nothing to say is an error.
         // Also timeout=0 does not help here (would need a change in asynGPIB),
         // thus use flush() for GPIB.
+        // Read in large blocks to keep the number of read calls low.
+        // Async records get each block in one intrCallbackOctet().
+        char* buffer = port->drainBuffer.clear().reserve(drainSize);
+        debug("AsynDriverInterface::writeHandler(%s): reading old input\n",
+            clientName());
         do {
-            char buffer [256];
             size_t received = 0;
             int eomReason = 0;
-            debug("AsynDriverInterface::writeHandler(%s): reading old input\n",
-                clientName());
             status = pasynOctet->read(pvtOctet, pasynUser,
-                buffer, sizeof(buffer), &received, &eomReason);
+                buffer, drainSize, &received, &eomReason);
             if (status == asynError || received == 0) break;
-            if (received) debug("AsynDriverInterface::writeHandler(%s): "
+            debug("AsynDriverInterface::writeHandler(%s): "
                 "flushing %" Z "u bytes: \"%s\"\n",
                 clientName(), received, StreamBuffer(buffer, received).expand()());
         } while (status == asynSuccess);
@@ -690,22 +1306,8 @@ writeHandler()
     // asyn do so?
 
     size_t streameoslen;
-    const char* streameos = getOutTerminator(streameoslen);
-    int oldeoslen = -1;
-    char oldeos[16];
-    if (streameos) // stream has already added eos, don't do it again in asyn
-    {
-        // clear terminator for asyn
-        status = pasynOctet->getOutputEos(pvtOctet,
-            pasynUser, oldeos, sizeof(oldeos)-1, &oldeoslen);
-        if (status != asynSuccess)
-        {
-            oldeoslen = -1;
-            // No EOS support?
-        }
-        pasynOctet->setOutputEos(pvtOctet, pasynUser,
-            NULL, 0);
-    }
+    setOutputEos(getOutTerminator(streameoslen));
+
     int writeTry = 0;
     do {
         pasynUser->errorMessage[0] = 0;
@@ -727,12 +1329,6 @@ writeHandler()
         // Let's try once more.
     } while (status == asynError && writeTry++ == 0 && connectToAsynPort());
 
-    if (oldeoslen >= 0) // restore asyn terminator
-    {
-        pasynOctet->setOutputEos(pvtOctet, pasynUser,
-            oldeos, oldeoslen);
-    }
-
     switch (status)
     {
         case asynSuccess:
@@ -858,65 +1454,34 @@ readRequest(unsigned long replyTimeout_ms, unsigned long readTimeout_ms,
 void AsynDriverInterface::
 readHandler()
 {
-    size_t streameoslen, deveoslen;
+    size_t streameoslen, deveoslen = 0;
     const char* streameos;
-    const char* deveos;
-    int oldeoslen = -1;
-    char oldeos[16];
+    char deveos[16];
 
     // Setup eos if required.
     streameos = getInTerminator(streameoslen);
-    deveos = streameos;
-    deveoslen = streameoslen;
-    if (streameos) // streameos == NULL means: don't change eos
+    setInputEos(streameos, streameoslen);
+    if (streameos && port->eosKnown && port->inputEos.len >= 0)
     {
-        asynStatus status;
-        status = pasynOctet->getInputEos(pvtOctet,
-            pasynUser, oldeos, sizeof(oldeos)-1, &oldeoslen);
-        if (status != asynSuccess)
-            oldeoslen = -1;
-        else do {
-            // device (e.g. GPIB) might not accept full eos length
-            if (deveoslen == (size_t)oldeoslen && strcmp(deveos, oldeos) == 0)
-            {
-                // nothing to do: old and new eos are the same
-                break;
-            }
-            if (pasynOctet->setInputEos(pvtOctet, pasynUser,
-                deveos, (int)deveoslen) == asynSuccess)
-            {
-                debug2("AsynDriverInterface::readHandler(%s) "
-                    "input EOS changed from \"%s\" to \"%s\"\n",
-                    clientName(),
-                    StreamBuffer(oldeos, oldeoslen).expand()(),
-                    StreamBuffer(deveos, deveoslen).expand()());
-                break;
-            }
-            deveos++; deveoslen--;
-            if (!deveoslen)
-            {
-                error("%s: warning: pasynOctet->setInputEos() failed: %s\n",
-                    clientName(), pasynUser->errorMessage);
-            }
-        } while (deveoslen);
+        // copy what the device (e.g. GPIB) has actually accepted
+        deveoslen = port->inputEos.len;
+        memcpy(deveos, port->inputEos.str, deveoslen);
     }
 
-    size_t bytesToRead = peeksize;
+    size_t bytesToRead;
     size_t buffersize;
+    size_t messageLength = 0;
 
+    // Do not peek with 1 byte reads. Read the whole message if its
+    // length is known, else as much as recent messages needed.
+    // The driver stops at the terminator and returns what is available.
     if (expectedLength > 0)
-    {
-        buffersize = expectedLength;
-        if (peeksize > 1)
-        {
-            /* we can't peek, try to read whole message */
-            bytesToRead = expectedLength;
-        }
-    }
+        bytesToRead = expectedLength;
     else
-    {
+        bytesToRead = readSize;
+    buffersize = bytesToRead;
+    if (buffersize < inputBuffer.capacity())
         buffersize = inputBuffer.capacity();
-    }
     char* buffer = inputBuffer.clear().reserve(buffersize);
 
     if (ioAction == AsyncRead)
@@ -955,6 +1520,9 @@ readHandler()
                 bytesToRead, pasynUser->timeout, toStr(status), received,
                 eomReasonToStr(eomReason), StreamBuffer(buffer, received).expand()());
 
+        if (ioAction == Read && (ssize_t)received > 0)
+            messageLength += received;
+
         // asyn 4.16 sets reason to ASYN_EOM_END when device disconnects.
         // What about earlier versions?
         if (!connected) eomReason |= ASYN_EOM_END;
@@ -1063,17 +1631,9 @@ readHandler()
                 readMore = readCallback(StreamIoTimeout, buffer, received);
                 break;
             case asynOverflow:
-                if (bytesToRead == 1)
-                {
-                    // device does not support peeking
-                    // try to read whole message next time
-                    inputBuffer.clear().reserve(100);
-                } else {
-                    // buffer was still too small
-                    // try larger buffer next time
-                    inputBuffer.clear().reserve(inputBuffer.capacity()*2);
-                }
-                peeksize = inputBuffer.capacity();
+                // buffer was too small (e.g. GPIB)
+                // try larger buffer next time
+                adaptReadSize(2 * bytesToRead);
                 // deliver whatever we could save
                 error("%s: asynOverflow in read: %s\n",
                     clientName(), pasynUser->errorMessage);
@@ -1111,7 +1671,11 @@ readHandler()
                 readCallback(StreamIoFault);
                 return;
         }
-        if (!readMore) break;
+        if (!readMore)
+        {
+            if (messageLength) adaptReadSize(messageLength);
+            break;
+        }
         if (readMore > 0)
         {
             bytesToRead = readMore;
@@ -1126,19 +1690,24 @@ readHandler()
         pasynUser->timeout = readTimeout;
         waitForReply = false;
     }
+}
 
-    // restore original EOS
-    if (oldeoslen >= 0 && oldeoslen != (int)deveoslen &&
-        strcmp(deveos, oldeos) != 0)
-    {
-        pasynOctet->setInputEos(pvtOctet, pasynUser,
-            oldeos, oldeoslen);
-        debug2("AsynDriverInterface::readHandler(%s) "
-            "input EOS restored from \"%s\" to \"%s\"\n",
-            clientName(),
-            StreamBuffer(deveos, deveoslen).expand()(),
-            StreamBuffer(oldeos, oldeoslen).expand()());
-    }
+// Size the first read of the next message after the recent messages:
+// Grow at once with some headroom for the terminator, shrink slowly.
+void AsynDriverInterface::
+adaptReadSize(size_t length)
+{
+    size_t size = length + length/4 + 16;
+
+    if (size > readSize)
+        readSize = size;
+    else
+        readSize -= (readSize - size) / 16;
+    if (readSize < minReadSize)
+        readSize = minReadSize;
+    debug2("AsynDriverInterface::adaptReadSize(%s): "
+        "message %" Z "u bytes, next read %" Z "u bytes\n",
+        clientName(), length, readSize);
 }
 
 void AsynDriverInterface::
@@ -1318,6 +1887,9 @@ exceptionHandler(asynException exception)
 
     if (exception == asynExceptionConnect)
     {
+        // driver may have reset EOS
+        port->eosKnown = false;
+        port->eosSaved = false;
         pasynManager->isConnected(pasynUser, &connected);
         debug("AsynDriverInterface::exceptionHandler(%s) %s %s. ioAction: %s\n",
             clientName(), name(),
@@ -1337,6 +1909,20 @@ timerExpired()
         case None:
             // Timeout of async poll crossed with parasitic input
             return;
+#ifndef EPICS_3_13
+        case Lock:
+        {
+            // timeout while waiting in the lock queue
+            // or queueRequest failed when we got the turn
+            bool failed = lockFailed;
+            lockFailed = false;
+            if (!failed && !dequeueLock())
+                return; // got the turn meanwhile
+            ioAction = None;
+            lockCallback(failed ? StreamIoFault : StreamIoTimeout);
+            return;
+        }
+#endif
         case ReceiveEvent:
             // timeout while waiting for event
             ioAction = None;
@@ -1468,6 +2054,21 @@ finish()
     debug("AsynDriverInterface::finish(%s) start\n",
         clientName());
     cancelTimer();
+#ifndef EPICS_3_13
+    if (ioAction == Lock)
+    {
+        // lock request aborted: a request still queued in asyn
+        // is ignored by handleRequest() because ioAction is None
+        dequeueLock();
+        if (pasynUser == port->groupUser && port->lockOwner == this)
+        {
+            // The groupUser cannot be queued again by the next member
+            // until that request has gone. Pass the lock when it comes.
+            groupDrain = true;
+        }
+        else passLock();
+    }
+#endif
     ioAction = None;
 //     if (pasynGpib)
 //     {
@@ -1479,11 +2080,40 @@ finish()
         clientName());
 }
 
+void AsynDriverInterface::
+printStatus(StreamBuffer& buffer)
+{
+#ifndef EPICS_3_13
+    epicsMutexMustLock(port->lockMutex);
+    buffer.print("lock queue %" Z "u (max %" Z "u), %lu locks, "
+        "wait %.1f ms avg %.1f ms max, %lu late",
+        port->lockQueueDepth, port->maxLockQueueDepth, port->locks,
+        port->locks ? port->lockWait * 1000 / port->locks : 0.0,
+        port->maxLockWait * 1000, port->lateLocks);
+    if (port->groupUser)
+        buffer.print(", %lu poll group handoffs", port->groupHandoffs);
+    if (port->lockOwner == this) buffer.append(" owner");
+    if (lockWaiting) buffer.append(" waiting");
+    epicsMutexUnlock(port->lockMutex);
+#endif
+}
+
 // asynUser callbacks to pasynManager->queueRequest()
 
 void AsynDriverInterface::
 handleRequest()
 {
+#ifndef EPICS_3_13
+    if (groupDrain)
+    {
+        // aborted lock request on groupUser
+        // (do not cancel the timer of a new lock request)
+        groupDrain = false;
+        releaseGroupUser();
+        passLock();
+        return;
+    }
+#endif
     cancelTimer();
     debug2("AsynDriverInterface::handleRequest(%s) %s\n",
         clientName(), toStr(ioAction));
@@ -1522,9 +2152,22 @@ handleTimeout()
 {
     debug("AsynDriverInterface::handleTimeout(%s)\n",
         clientName());
+#ifndef EPICS_3_13
+    if (groupDrain)
+    {
+        groupDrain = false;
+        releaseGroupUser();
+        passLock();
+        return;
+    }
+#endif
     switch (ioAction)
     {
         case Lock:
+#ifndef EPICS_3_13
+            releaseGroupUser();
+            passLock();
+#endif
             lockCallback(StreamIoTimeout);
             break;
         case Write:
@@ -35,7 +35,238 @@ class EnumConverter : public StreamFormatConverter
     ssize_t scanLong(const StreamFormat&, const char*, long&);
 };
 
-// info format: <numEnums><index><string>0<index><string>0...
+// info format: <numEnums><table><index><string>0<index><string>0...[lookup]
+// table is the offset of the lookup data behind the strings or 0.
+
+// Enums with many choices get a lookup structure:
+// a trie for input formats and an index table for output formats.
+// All offsets are relative to the start of info.
+
+typedef unsigned short EnumOffset;
+
+static const long minTableChoices = 8;
+
+/* Trie node:
+   <minChoice><choice><labelLen><label><wildcard><numKeys><keys><children>
+   choice is the offset of <index> of the choice ending here or 0,
+   minChoice the lowest of all choices in the sub-trie.
+   The label contains the literal characters leading to the node,
+   beginning with the key. The wildcard child skips one character first.
+   Because offsets grow with the position in the list, the lowest
+   matching offset is the same choice the linear search finds first.
+*/
+
+struct EnumTrieNode
+{
+    char key;
+    EnumOffset choice;
+    EnumOffset minChoice;
+    EnumTrieNode* wildcard;
+    EnumTrieNode* children;
+    EnumTrieNode* next;
+
+    EnumTrieNode(char key = 0) : key(key), choice(0), minChoice(0xffff),
+        wildcard(NULL), children(NULL), next(NULL) {}
+    ~EnumTrieNode()
+    {
+        delete wildcard;
+        delete children;
+        delete next;
+    }
+    EnumTrieNode* child(char c)
+    {
+        // keep children sorted for binary search in scanLong
+        EnumTrieNode** pn = &children;
+        while (*pn && (unsigned char)(*pn)->key < (unsigned char)c)
+            pn = &(*pn)->next;
+        if (!*pn || (*pn)->key != c)
+        {
+            EnumTrieNode* n = new EnumTrieNode(c);
+            n->next = *pn;
+            *pn = n;
+        }
+        return *pn;
+    }
+};
+
+// returns offset of the node or 0 if info grows too big
+static EnumOffset writeTrie(StreamBuffer& info, EnumTrieNode* node, bool withKey)
+{
+    size_t pos = info.length();
+    EnumOffset minChoice = node->minChoice;
+    StreamBuffer label;
+
+    if (withKey) label.append(node->key);
+    // collapse chains of nodes with only one child into one label
+    while (!node->choice && !node->wildcard && node->children && !node->children->next)
+    {
+        node = node->children;
+        label.append(node->key);
+    }
+    EnumOffset n = (EnumOffset)label.length();
+    info.append(&minChoice, sizeof(minChoice));
+    info.append(&node->choice, sizeof(node->choice));
+    info.append(&n, sizeof(n));
+    info.append(label);
+    size_t wildcard = info.length();
+    info.append('\0', sizeof(EnumOffset));
+    EnumTrieNode* c;
+    for (n = 0, c = node->children; c; c = c->next) n++;
+    info.append(&n, sizeof(n));
+    for (c = node->children; c; c = c->next)
+        info.append(c->key);
+    size_t children = info.length();
+    info.append('\0', n * sizeof(EnumOffset));
+    if (info.length() >= 0xffff) return 0;
+
+    EnumOffset o;
+    if (node->wildcard)
+    {
+        if (!(o = writeTrie(info, node->wildcard, false))) return 0;
+        memcpy(info(wildcard), &o, sizeof(o));
+    }
+    for (c = node->children; c; c = c->next, children += sizeof(o))
+    {
+        if (!(o = writeTrie(info, c, true))) return 0;
+        memcpy(info(children), &o, sizeof(o));
+    }
+    return (EnumOffset)pos;
+}
+
+static EnumOffset buildTrie(StreamBuffer& info, long numEnums)
+{
+    EnumTrieNode root;
+    const char* s = info(sizeof(long) + sizeof(EnumOffset));
+
+    while (numEnums--)
+    {
+        EnumOffset choice = (EnumOffset)(s - info());
+        EnumTrieNode* node = &root;
+        s += sizeof(long);
+        if (node->minChoice == 0xffff) node->minChoice = choice;
+        while (*s)
+        {
+            if (*s == StreamProtocolParser::skip)
+            {
+                if (!node->wildcard) node->wildcard = new EnumTrieNode;
+                node = node->wildcard;
+                s++;
+            }
+            else
+            {
+                if (*s == esc) s++;
+                node = node->child(*s++);
+            }
+            if (node->minChoice == 0xffff) node->minChoice = choice;
+        }
+        s++;
+        if (!node->choice) node->choice = choice;
+    }
+    return writeTrie(info, &root, false);
+}
+
+/* Index table:
+   <default><min><size><offset>... for dense values,
+   <default><0><size><value><offset>... sorted by value otherwise.
+   offset is the offset of the choice string, 0 if no choice has this value.
+*/
+
+struct EnumValue
+{
+    long value;
+    EnumOffset offset;
+};
+
+static int compareEnumValues(const void* a, const void* b)
+{
+    const EnumValue* x = static_cast<const EnumValue*>(a);
+    const EnumValue* y = static_cast<const EnumValue*>(b);
+    if (x->value != y->value) return x->value < y->value ? -1 : 1;
+    // the first choice in the list wins
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static EnumOffset buildIndexTable(StreamBuffer& info, long numEnums, bool hasDefault)
+{
+    const char* s = info(sizeof(long) + sizeof(EnumOffset));
+    EnumValue* values = new EnumValue[numEnums];
+    EnumOffset defaultOffset = 0;
+    long i, size;
+
+    for (i = 0; i <= numEnums; i++)
+    {
+        if (i == numEnums && !hasDefault) break;
+        long index = extract<long>(s);
+        EnumOffset offset = (EnumOffset)(s - info());
+        while (*s)
+        {
+            if (*s == esc) s++;
+            s++;
+        }
+        s++;
+        if (i == numEnums)
+        {
+            defaultOffset = offset;
+            break;
+        }
+        values[i].value = index;
+        values[i].offset = offset;
+    }
+    qsort(values, numEnums, sizeof(EnumValue), compareEnumValues);
+    for (size = 1, i = 1; i < numEnums; i++)
+        if (values[i].value != values[size-1].value)
+            values[size++] = values[i];
+
+    size_t pos = info.length();
+    unsigned long range = (unsigned long)values[size-1].value - (unsigned long)values[0].value;
+    bool dense = range < (unsigned long)(4 * size);
+    long min = dense ? values[0].value : 0;
+    EnumOffset n = (EnumOffset)(dense ? range + 1 : size);
+    info.append(&defaultOffset, sizeof(defaultOffset));
+    info.append(&dense, sizeof(dense));
+    info.append(&min, sizeof(min));
+    info.append(&n, sizeof(n));
+    if (dense)
+    {
+        size_t table = info.length();
+        info.append('\0', n * sizeof(EnumOffset));
+        for (i = 0; i < size; i++)
+            memcpy(info(table + (values[i].value - min) * sizeof(EnumOffset)),
+                &values[i].offset, sizeof(EnumOffset));
+    }
+    else
+    {
+        for (i = 0; i < size; i++)
+        {
+            info.append(&values[i].value, sizeof(long));
+            info.append(&values[i].offset, sizeof(EnumOffset));
+        }
+    }
+    delete[] values;
+    return info.length() < 0xffff ? (EnumOffset)pos : 0;
+}
+
+static void addLookup(StreamBuffer& info, long numEnums, bool scanFormat)
+{
+    bool hasDefault = numEnums < 0;
+    if (hasDefault) numEnums = -numEnums-1;
+    if (numEnums < minTableChoices || info.length() >= 0xffff) return;
+
+    size_t end = info.length();
+    EnumOffset table = scanFormat ?
+        buildTrie(info, numEnums) :
+        buildIndexTable(info, numEnums, hasDefault);
+    if (!table)
+    {
+        // too big for format info, use linear search
+        debug2("EnumConverter::parse: enum too big for lookup table\n");
+        info.truncate(end);
+        return;
+    }
+    memcpy(info(sizeof(long)), &table, sizeof(table));
+    debug2("EnumConverter::parse: %s of %" PRINTF_SIZE_T_PREFIX "u bytes\n",
+        scanFormat ? "trie" : "index table", info.length() - end);
+}
 
 int EnumConverter::
 parse(const StreamFormat& fmt, StreamBuffer& info,
@@ -48,8 +279,9 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
         return false;
     }
     long numEnums = 0;
-    size_t n = info.length(); // put numEnums here later
-    info.append(&numEnums, sizeof(numEnums));
+    info.append(&numEnums, sizeof(numEnums)); // put numEnums here later
+    EnumOffset table = 0;
+    info.append(&table, sizeof(table)); // put lookup table offset here later
     long index = 0;
     size_t i = 0;
     i = info.length(); // put index here later
@@ -76,9 +308,10 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
                 source++;
                 numEnums = -(numEnums+1);
                 info.append('\0');
-                memcpy(info(n), &numEnums, sizeof(numEnums));
+                memcpy(info(0), &numEnums, sizeof(numEnums));
                 debug2("EnumConverter::parse %ld choices with default: %s\n",
                     -numEnums, info.expand()());
+                addLookup(info, numEnums, scanFormat);
                 return enum_format;
             }
 
@@ -99,9 +332,10 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
 
             if (*source++ == '}')
             {
-                memcpy(info(n), &numEnums, sizeof(numEnums));
+                memcpy(info(0), &numEnums, sizeof(numEnums));
                 debug2("EnumConverter::parse %ld choices: %s\n",
                     numEnums, info.expand()());
+                addLookup(info, numEnums, scanFormat);
                 return enum_format;
             }
             index++;
@@ -119,29 +353,79 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
     return false;
 }
 
+static EnumOffset lookupIndex(const char* info, EnumOffset table, long value)
+{
+    const char* t = info + table;
+    EnumOffset defaultOffset = extract<EnumOffset>(t);
+    bool dense = extract<bool>(t);
+    long min = extract<long>(t);
+    EnumOffset n = extract<EnumOffset>(t);
+    EnumOffset offset = 0;
+
+    if (dense)
+    {
+        if (value >= min && (unsigned long)value - (unsigned long)min < n)
+            memcpy(&offset, t + (value - min) * sizeof(EnumOffset), sizeof(offset));
+    }
+    else
+    {
+        const size_t entrySize = sizeof(long) + sizeof(EnumOffset);
+        size_t lo = 0, hi = n;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            const char* e = t + mid * entrySize;
+            long v = extract<long>(e);
+            if (v == value)
+            {
+                offset = extract<EnumOffset>(e);
+                break;
+            }
+            if (v < value) lo = mid + 1;
+            else hi = mid;
+        }
+    }
+    return offset ? offset : defaultOffset;
+}
+
 bool EnumConverter::
 printLong(const StreamFormat& fmt, StreamBuffer& output, long value)
 {
     const char* s = fmt.info;
     long numEnums = extract<long>(s);
-    long index = extract<long>(s);
-    bool noDefault = numEnums >= 0;
+    EnumOffset table = extract<EnumOffset>(s);
 
-    if (numEnums < 0) numEnums=-numEnums-1;
-    while (numEnums-- && (value != index))
+    if (table)
     {
-        while (*s)
+        EnumOffset offset = lookupIndex(fmt.info, table, value);
+        if (!offset)
         {
-            if (*s == esc) s++;
-            s++;
+            error("Value %li not found in enum set\n", value);
+            return false;
         }
-        s++;
-        index = extract<long>(s);
+        s = fmt.info + offset;
     }
-    if (numEnums == -1 && noDefault)
+    else
     {
-        error("Value %li not found in enum set\n", value);
-        return false;
+        long index = extract<long>(s);
+        bool noDefault = numEnums >= 0;
+
+        if (numEnums < 0) numEnums=-numEnums-1;
+        while (numEnums-- && (value != index))
+        {
+            while (*s)
+            {
+                if (*s == esc) s++;
+                s++;
+            }
+            s++;
+            index = extract<long>(s);
+        }
+        if (numEnums == -1 && noDefault)
+        {
+            error("Value %li not found in enum set\n", value);
+            return false;
+        }
     }
     while (*s)
     {
@@ -151,6 +435,46 @@ printLong(const StreamFormat& fmt, StreamBuffer& output, long value)
     return true;
 }
 
+static void matchTrie(const char* info, EnumOffset node, const char* input,
+    ssize_t consumed, EnumOffset& best, ssize_t& bestConsumed)
+{
+    const char* t = info + node;
+    if (extract<EnumOffset>(t) >= best)
+        return; // nothing better in this sub-trie
+    EnumOffset choice = extract<EnumOffset>(t);
+    EnumOffset len = extract<EnumOffset>(t);
+    if (memcmp(t, input + consumed, len) != 0)
+        return;
+    t += len;
+    consumed += len;
+    if (choice && choice < best)
+    {
+        best = choice;
+        bestConsumed = consumed;
+    }
+    EnumOffset wildcard = extract<EnumOffset>(t);
+    EnumOffset n = extract<EnumOffset>(t);
+    const char* keys = t;
+    const char* children = t + n;
+    unsigned char c = input[consumed];
+    EnumOffset lo = 0, hi = n;
+    while (lo < hi)
+    {
+        EnumOffset mid = (lo + hi) / 2;
+        unsigned char k = keys[mid];
+        if (k == c)
+        {
+            memcpy(&node, children + mid * sizeof(EnumOffset), sizeof(node));
+            matchTrie(info, node, input, consumed, best, bestConsumed);
+            break;
+        }
+        if (k < c) lo = mid + 1;
+        else hi = mid;
+    }
+    if (wildcard)
+        matchTrie(info, wildcard, input, consumed + 1, best, bestConsumed);
+}
+
 ssize_t EnumConverter::
 scanLong(const StreamFormat& fmt, const char* input, long& value)
 {
@@ -158,10 +482,25 @@ scanLong(const StreamFormat& fmt, const char* input, long& value)
         fmt.conv, input);
     const char* s = fmt.info;
     long numEnums = extract<long>(s);
+    EnumOffset table = extract<EnumOffset>(s);
     long index;
     ssize_t consumed;
     bool match;
 
+    if (table)
+    {
+        EnumOffset best = 0xffff;
+        matchTrie(fmt.info, table, input, 0, best, consumed);
+        if (best == 0xffff)
+        {
+            debug("EnumConverter::scanLong: no value matches\n");
+            return -1;
+        }
+        s = fmt.info + best;
+        value = extract<long>(s);
+        debug("EnumConverter::scanLong: value %ld matches\n", value);
+        return consumed;
+    }
     while (numEnums--)
     {
         index = extract<long>(s);
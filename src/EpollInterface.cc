@@ -0,0 +1,1818 @@
+/*************************************************************************
+* This is a native bus interface for TCP and UDP sockets and serial lines
+* for StreamDevice on Linux. It does not need asynDriver.
+* Please see ../docs/ for detailed documentation.
+*
+* This file is part of StreamDevice.
+*
+* StreamDevice is free software: You can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* StreamDevice is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with StreamDevice. If not, see https://www.gnu.org/licenses/.
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <termios.h>
+
+#include "epicsTypes.h"
+#include "epicsMutex.h"
+#include "epicsThread.h"
+#include "iocsh.h"
+
+#include "StreamBusInterface.h"
+#include "StreamError.h"
+#include "StreamBuffer.h"
+
+#define Z PRINTF_SIZE_T_PREFIX
+
+// This bus interface talks to TCP sockets, UDP sockets and serial lines
+// directly.
+// All file descriptors are non-blocking and are handled by one thread
+// which waits for all of them with epoll.
+// The request methods only store the request and wake up the thread.
+// All callbacks are called from that thread, never with the mutex held.
+// Input is received into one buffer per port and is passed to
+// readCallback() from there, split at the input terminator.
+// Bytes after the terminator stay in the buffer for the next read.
+// UDP input is received in batches of datagrams. Each datagram is
+// passed to readCallback() as one message with StreamIoEnd.
+//
+// Configure a port with one of the iocsh commands
+//   streamTcpConfigure name host:port
+//   streamSerialConfigure name device [baud] [format] [flow]
+//   streamUdpConfigure name [host:port,...] [localport]
+
+class EpollInterface;
+
+class EpollPort
+{
+public:
+    enum State {Disconnected, Connecting, Connected};
+
+    static EpollPort* first;
+    EpollPort* next;
+    char* name;
+    char* target;         // host:port or device
+    int fd;
+    State state;
+    bool everConnected;   // notify clients on re-connect
+    bool errorReported;   // report connect errors only once
+    bool offline;         // disconnected by disconnect command
+    bool readable;
+    bool writable;
+    bool hangup;
+    bool datagrams;       // input comes as messages, not as a stream
+    unsigned int interest;
+    unsigned long long connectDeadline;
+    unsigned long long retryTime;
+    EpollInterface* clients;   // all clients of this port
+    EpollInterface* lockQueue; // clients waiting for lock
+    EpollInterface* owner;     // client holding the lock
+    size_t deliverSize;      // input currently passed to clients
+    size_t bufferSize;
+    char* buffer;
+    char* input;             // current input, somewhere in buffer
+    size_t inputStart;
+    size_t inputEnd;
+
+    EpollPort(const char* name, const char* target,
+        size_t bufferSize = 16384);
+    virtual ~EpollPort();
+    static EpollPort* find(const char* name);
+    static bool add(EpollPort* port);
+    void startConnect(unsigned long long now);
+    void finishConnect(unsigned long long now, int err);
+    void closeFd(unsigned long long now);
+    EpollInterface* primaryReader();
+    bool wantsInput();
+    bool step(unsigned long long now);
+    void updateInterest();
+    unsigned long long nextDeadline();
+    void printStatus(StreamBuffer& buffer);
+
+    // device specific part
+    // return 0 when connected, EINPROGRESS when pending or errno
+    virtual int open() = 0;
+    virtual int connectStatus();
+    virtual ssize_t sendBytes(const void* data, size_t size);
+    virtual ssize_t receiveBytes(void* data, size_t size);
+    virtual void flush();
+    virtual bool receive(unsigned long long now);
+};
+
+class TcpPort : public EpollPort
+{
+    struct sockaddr_storage address;
+    socklen_t addrlen;
+
+    int open();
+    int connectStatus();
+    ssize_t sendBytes(const void* data, size_t size);
+    ssize_t receiveBytes(void* data, size_t size);
+public:
+    TcpPort(const char* name, const char* hostport,
+        const struct addrinfo* ai);
+};
+
+class SerialPort : public EpollPort
+{
+    speed_t speed;
+    tcflag_t cflag;
+    tcflag_t iflag;
+
+    int open();
+public:
+    SerialPort(const char* name, const char* device,
+        speed_t speed, tcflag_t cflag, tcflag_t iflag);
+};
+
+class UdpPort : public EpollPort
+{
+    static const int batchSize = 16;
+    static const size_t datagramSize = 9216;
+    int family;
+    unsigned short localPort;
+    int numDestinations;
+    struct sockaddr_storage* destinations;
+    socklen_t* destinationLengths;
+    struct sockaddr_storage sender;   // of the last datagram
+    socklen_t senderLength;
+    struct sockaddr_storage addresses[batchSize];
+    struct iovec iov[batchSize];
+    struct mmsghdr messages[batchSize];
+    int received;   // datagrams from the last recvmmsg
+    int current;    // datagram currently in input
+    int sent;       // destinations which already got the current output
+
+    int open();
+    ssize_t sendBytes(const void* data, size_t size);
+    void flush();
+    bool receive(unsigned long long now);
+    int receiveBatch();
+public:
+    UdpPort(const char* name, const char* destinationList,
+        int family, unsigned short localPort, int numDestinations,
+        const struct addrinfo* const* ai);
+    ~UdpPort();
+};
+
+class EpollInterface : StreamBusInterface
+{
+    friend class EpollPort;
+
+    enum IoAction {None, Lock, Write, Read, AsyncRead, Event, Connect,
+        Disconnect};
+    static const char* toStr(IoAction action);
+
+    EpollPort* port;
+    EpollInterface* nextClient;
+    EpollInterface* nextLock;
+    IoAction ioAction;
+    unsigned long long deadline;
+    const char* output;
+    size_t outputSize;
+    bool flushPending;
+    unsigned long readTimeout_ms;
+    ssize_t expectedLength;
+    bool gotInput;
+    bool deliver;
+    bool connectNotify;
+
+    EpollInterface(Client* client, EpollPort* port);
+    ~EpollInterface();
+
+    // StreamBusInterface methods
+    bool lockRequest(unsigned long lockTimeout_ms);
+    bool unlock();
+    bool writeRequest(const void* output, size_t size,
+        unsigned long writeTimeout_ms);
+    bool readRequest(unsigned long replyTimeout_ms,
+        unsigned long readTimeout_ms, ssize_t expectedLength, bool async);
+    bool supportsEvent();
+    bool supportsAsyncRead();
+    bool acceptEvent(unsigned long mask, unsigned long replytimeout_ms);
+    bool connectRequest(unsigned long connecttimeout_ms);
+    bool disconnectRequest();
+    void finish();
+    void release();
+    void printStatus(StreamBuffer& buffer);
+
+    ssize_t callback(IoAction action, StreamIoStatus status,
+        const char* input = NULL, size_t size = 0);
+    void removeFromLockQueue();
+
+public:
+    // static creator method
+    static StreamBusInterface* getBusInterface(Client* client,
+        const char* busname, int addr, const char* param);
+};
+
+RegisterStreamBusInterface(EpollInterface);
+
+// Time between connection attempts and max time for one attempt
+static const unsigned long long reconnectPeriod_ms = 5000;
+static const unsigned long long connectTimeout_ms = 5000;
+static const int maxEvents = 64;
+
+static epicsMutexId epollMutex;
+static epicsThreadId epollThreadId;
+static int epollFd = -1;
+static int wakeFd = -1;
+static EpollInterface* calling;       // client in callback
+static EpollInterface* releasedInCallback;
+
+EpollPort* EpollPort::first;
+
+static unsigned long long now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void wakeThread()
+{
+    if (epicsThreadGetIdSelf() == epollThreadId) return;
+    epicsUInt64 one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        error("EpollInterface: cannot wake up I/O thread: %s\n",
+            strerror(errno));
+}
+
+static void epollThread(void*)
+{
+    struct epoll_event events[maxEvents];
+    EpollPort* port;
+    unsigned long long now, next, d;
+    int i, n, timeout;
+
+    epicsMutexMustLock(epollMutex);
+    while (1)
+    {
+        now = now_ms();
+        for (port = EpollPort::first; port; port = port->next)
+        {
+            while (port->step(now));
+            port->updateInterest();
+        }
+        next = 0;
+        for (port = EpollPort::first; port; port = port->next)
+        {
+            d = port->nextDeadline();
+            if (d && (!next || d < next)) next = d;
+        }
+        now = now_ms();
+        timeout = !next ? -1 : next <= now ? 0 : (int)(next - now);
+        epicsMutexUnlock(epollMutex);
+        n = epoll_wait(epollFd, events, maxEvents, timeout);
+        epicsMutexMustLock(epollMutex);
+        if (n < 0 && errno != EINTR)
+        {
+            error("EpollInterface: epoll_wait failed: %s\n",
+                strerror(errno));
+            epicsThreadSleep(1.0);
+        }
+        for (i = 0; i < n; i++)
+        {
+            port = static_cast<EpollPort*>(events[i].data.ptr);
+            if (!port)
+            {
+                epicsUInt64 count;
+                if (read(wakeFd, &count, sizeof(count)) < 0) {}
+                continue;
+            }
+            if (events[i].events & EPOLLIN)
+                port->readable = true;
+            if (events[i].events & EPOLLOUT)
+                port->writable = true;
+            if (events[i].events & (EPOLLERR|EPOLLHUP))
+            {
+                port->readable = port->writable = true;
+                if (port->state == EpollPort::Connected)
+                    port->hangup = true;
+            }
+        }
+    }
+}
+
+// EpollPort: the connection and its state
+
+EpollPort::
+EpollPort(const char* name, const char* target, size_t bufferSize) :
+    next(NULL), fd(-1), state(Disconnected),
+    everConnected(false), errorReported(false), offline(false),
+    readable(false), writable(false), hangup(false), datagrams(false),
+    interest(0), connectDeadline(0), retryTime(0),
+    clients(NULL), lockQueue(NULL), owner(NULL), deliverSize(0),
+    bufferSize(bufferSize), inputStart(0), inputEnd(0)
+{
+    buffer = new char[bufferSize];
+    input = buffer;
+    this->name = new char[strlen(name) + 1];
+    strcpy(this->name, name);
+    this->target = new char[strlen(target) + 1];
+    strcpy(this->target, target);
+}
+
+EpollPort::
+~EpollPort()
+{
+    delete[] name;
+    delete[] target;
+    delete[] buffer;
+}
+
+EpollPort* EpollPort::
+find(const char* name)
+{
+    EpollPort* port;
+    for (port = first; port; port = port->next)
+        if (strcmp(port->name, name) == 0) break;
+    return port;
+}
+
+void EpollPort::
+startConnect(unsigned long long now)
+{
+    int err;
+
+    debug("EpollPort::startConnect(%s) to %s\n", name, target);
+    inputStart = inputEnd = 0;
+    readable = writable = hangup = false;
+    interest = EPOLLOUT;
+    state = Connecting;
+    connectDeadline = now + connectTimeout_ms;
+    err = open();
+    if (err != 0 && err != EINPROGRESS)
+    {
+        finishConnect(now, err);
+        return;
+    }
+    struct epoll_event event;
+    event.events = interest;
+    event.data.ptr = this;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+        err = errno;
+    if (err != EINPROGRESS)
+        finishConnect(now, err);
+}
+
+void EpollPort::
+finishConnect(unsigned long long now, int err)
+{
+    EpollInterface* client;
+
+    if (err)
+    {
+        if (!errorReported)
+            error("%s: Cannot connect to %s: %s\n",
+                name, target, strerror(err));
+        errorReported = true;
+        closeFd(now);
+        return;
+    }
+    debug("EpollPort::finishConnect(%s) connected to %s\n",
+        name, target);
+    state = Connected;
+    writable = true;
+    errorReported = false;
+    if (everConnected)
+    {
+        // re-connect: let idle clients run @init
+        for (client = clients; client; client = client->nextClient)
+            if (client->ioAction == EpollInterface::None && client != owner)
+                client->connectNotify = true;
+    }
+    everConnected = true;
+}
+
+void EpollPort::
+closeFd(unsigned long long now)
+{
+    debug("EpollPort::closeFd(%s)\n", name);
+    // closing removes fd from epoll
+    if (fd >= 0) close(fd);
+    fd = -1;
+    interest = 0;
+    state = Disconnected;
+    readable = writable = hangup = false;
+    retryTime = now + reconnectPeriod_ms;
+    // keep the input buffer for the current reader
+}
+
+void EpollPort::
+flush()
+{
+    ssize_t received;
+
+    inputStart = inputEnd = 0;
+    if (state != Connected) return;
+    do {
+        received = receiveBytes(buffer, bufferSize);
+        if (received > 0)
+            debug("EpollPort::flush(%s): flushing %" Z "d bytes: \"%s\"\n",
+                name, received, StreamBuffer(buffer, received).expand()());
+    } while (received > 0);
+    // EOF and errors are found by the next receive()
+    readable = received == 0 || errno != EAGAIN;
+}
+
+bool EpollPort::
+receive(unsigned long long now)
+{
+    ssize_t received;
+
+    // only called when the input buffer is empty
+    input = buffer;
+    inputStart = inputEnd = 0;
+    received = receiveBytes(buffer, bufferSize);
+    if (received > 0)
+    {
+        debug("EpollPort::receive(%s): %" Z "d bytes \"%s\"\n",
+            name, received, StreamBuffer(buffer, received).expand()());
+        inputEnd = received;
+        return true;
+    }
+    if (received < 0 && errno == EAGAIN)
+    {
+        readable = false;
+        hangup = false;
+        return false;
+    }
+    if (received == 0)
+        debug("EpollPort::receive(%s): connection closed by %s\n",
+            name, target);
+    else
+        error("%s: Read error from %s: %s\n",
+            name, target, strerror(errno));
+    closeFd(now);
+    return true;
+}
+
+int EpollPort::
+connectStatus()
+{
+    return 0;
+}
+
+ssize_t EpollPort::
+sendBytes(const void* data, size_t size)
+{
+    return write(fd, data, size);
+}
+
+ssize_t EpollPort::
+receiveBytes(void* data, size_t size)
+{
+    return read(fd, data, size);
+}
+
+// TcpPort: a TCP socket
+
+TcpPort::
+TcpPort(const char* name, const char* hostport, const struct addrinfo* ai) :
+    EpollPort(name, hostport)
+{
+    memcpy(&address, ai->ai_addr, ai->ai_addrlen);
+    addrlen = ai->ai_addrlen;
+}
+
+int TcpPort::
+open()
+{
+    int one = 1;
+
+    fd = socket(address.ss_family,
+        SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+    if (fd < 0) return errno;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr*)&address, addrlen) < 0)
+        return errno;
+    return 0;
+}
+
+int TcpPort::
+connectStatus()
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    struct sockaddr_storage peer;
+    socklen_t peerlen = sizeof(peer);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+        return errno;
+    if (!err && getpeername(fd, (struct sockaddr*)&peer, &peerlen) < 0)
+        return EINPROGRESS;
+    return err;
+}
+
+ssize_t TcpPort::
+sendBytes(const void* data, size_t size)
+{
+    // no SIGPIPE when the peer has closed the connection
+    return send(fd, data, size, MSG_NOSIGNAL);
+}
+
+ssize_t TcpPort::
+receiveBytes(void* data, size_t size)
+{
+    return recv(fd, data, size, 0);
+}
+
+// SerialPort: a tty or pty in raw mode
+
+SerialPort::
+SerialPort(const char* name, const char* device,
+    speed_t speed, tcflag_t cflag, tcflag_t iflag) :
+    EpollPort(name, device), speed(speed), cflag(cflag), iflag(iflag)
+{
+}
+
+int SerialPort::
+open()
+{
+    struct termios tio;
+
+    fd = ::open(target, O_RDWR|O_NOCTTY|O_NONBLOCK|O_CLOEXEC);
+    if (fd < 0) return errno;
+    if (tcgetattr(fd, &tio) < 0) return errno;
+    // Raw input: every byte is passed on as soon as it arrives.
+    // With O_NONBLOCK, VMIN and VTIME do not delay read().
+    cfmakeraw(&tio);
+    tio.c_cflag &= ~(CSIZE|PARENB|PARODD|CSTOPB|CRTSCTS);
+    tio.c_cflag |= cflag|CREAD|CLOCAL;
+    tio.c_iflag &= ~(IXON|IXOFF|IXANY);
+    tio.c_iflag |= iflag;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd, TCSANOW, &tio) < 0) return errno;
+    tcflush(fd, TCIOFLUSH);
+    return 0;
+}
+
+// UdpPort: a UDP socket, sending to a list of destinations
+
+UdpPort::
+UdpPort(const char* name, const char* destinationList,
+    int family, unsigned short localPort, int numDestinations,
+    const struct addrinfo* const* ai) :
+    EpollPort(name, destinationList, batchSize * datagramSize),
+    family(family), localPort(localPort), numDestinations(numDestinations),
+    senderLength(0), received(0), current(0), sent(0)
+{
+    int i;
+
+    datagrams = true;
+    destinations = new struct sockaddr_storage[numDestinations + 1];
+    destinationLengths = new socklen_t[numDestinations + 1];
+    for (i = 0; i < numDestinations; i++)
+    {
+        memcpy(&destinations[i], ai[i]->ai_addr, ai[i]->ai_addrlen);
+        destinationLengths[i] = ai[i]->ai_addrlen;
+    }
+    for (i = 0; i < batchSize; i++)
+    {
+        iov[i].iov_base = buffer + i * datagramSize;
+        iov[i].iov_len = datagramSize;
+    }
+}
+
+UdpPort::
+~UdpPort()
+{
+    delete[] destinations;
+    delete[] destinationLengths;
+}
+
+int UdpPort::
+open()
+{
+    int one = 1;
+    int rcvbuf = 1 << 20;
+
+    received = current = sent = 0;
+    fd = socket(family, SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+    if (fd < 0) return errno;
+    // room for bursts of datagrams while the thread is busy
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (localPort)
+    {
+        struct sockaddr_storage local;
+        socklen_t locallen;
+
+        memset(&local, 0, sizeof(local));
+        if (family == AF_INET6)
+        {
+            struct sockaddr_in6* a = (struct sockaddr_in6*)&local;
+            a->sin6_family = AF_INET6;
+            a->sin6_addr = in6addr_any;
+            a->sin6_port = htons(localPort);
+            locallen = sizeof(*a);
+        }
+        else
+        {
+            struct sockaddr_in* a = (struct sockaddr_in*)&local;
+            a->sin_family = AF_INET;
+            a->sin_addr.s_addr = htonl(INADDR_ANY);
+            a->sin_port = htons(localPort);
+            locallen = sizeof(*a);
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr*)&local, locallen) < 0)
+            return errno;
+    }
+    return 0;
+}
+
+// Send the output as one datagram to all destinations with one system
+// call. Without destinations, reply to the sender of the last datagram.
+ssize_t UdpPort::
+sendBytes(const void* data, size_t size)
+{
+    struct iovec out;
+    struct mmsghdr msgs[batchSize];
+    struct sockaddr_storage* dest = destinations;
+    socklen_t* destlen = destinationLengths;
+    int count = numDestinations;
+    int i, n;
+
+    if (!count)
+    {
+        if (!senderLength)
+        {
+            errno = EDESTADDRREQ;
+            return -1;
+        }
+        dest = &sender;
+        destlen = &senderLength;
+        count = 1;
+    }
+    out.iov_base = const_cast<void*>(data);
+    out.iov_len = size;
+    while (sent < count)
+    {
+        n = count - sent;
+        if (n > batchSize) n = batchSize;
+        memset(msgs, 0, n * sizeof(msgs[0]));
+        for (i = 0; i < n; i++)
+        {
+            msgs[i].msg_hdr.msg_name = &dest[sent + i];
+            msgs[i].msg_hdr.msg_namelen = destlen[sent + i];
+            msgs[i].msg_hdr.msg_iov = &out;
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        n = sendmmsg(fd, msgs, n, 0);
+        if (n < 0) return -1;
+        sent += n;
+    }
+    sent = 0;
+    return size;
+}
+
+int UdpPort::
+receiveBatch()
+{
+    int i, n;
+
+    received = current = 0;
+    memset(messages, 0, sizeof(messages));
+    for (i = 0; i < batchSize; i++)
+    {
+        messages[i].msg_hdr.msg_name = &addresses[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+        messages[i].msg_hdr.msg_iov = &iov[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    n = recvmmsg(fd, messages, batchSize, MSG_DONTWAIT, NULL);
+    if (n > 0) received = n;
+    return n;
+}
+
+void UdpPort::
+flush()
+{
+    int n, i;
+
+    input = buffer;
+    inputStart = inputEnd = 0;
+    if (state != Connected) return;
+    for (i = current + 1; i < received; i++)
+        debug("UdpPort::flush(%s): flushing datagram \"%s\"\n",
+            name, StreamBuffer(iov[i].iov_base,
+                messages[i].msg_len).expand()());
+    do {
+        n = receiveBatch();
+        for (i = 0; i < n; i++)
+            debug("UdpPort::flush(%s): flushing datagram \"%s\"\n",
+                name, StreamBuffer(iov[i].iov_base,
+                    messages[i].msg_len).expand()());
+    } while (n > 0);
+    received = current = 0;
+    readable = n == 0 || errno != EAGAIN;
+}
+
+// Take the next datagram from the last batch or receive a new batch.
+bool UdpPort::
+receive(unsigned long long now)
+{
+    int n;
+
+    inputStart = inputEnd = 0;
+    while (1)
+    {
+        if (received && current + 1 < received)
+            current++;
+        else
+        {
+            n = receiveBatch();
+            if (n < 0)
+            {
+                if (errno == EAGAIN)
+                {
+                    readable = false;
+                    return false;
+                }
+                error("%s: Read error: %s\n", name, strerror(errno));
+                closeFd(now);
+                return true;
+            }
+            if (n == 0)
+            {
+                readable = false;
+                return false;
+            }
+            current = 0;
+        }
+        // ignore empty datagrams
+        if (messages[current].msg_len) break;
+    }
+    input = (char*)iov[current].iov_base;
+    inputEnd = messages[current].msg_len;
+    memcpy(&sender, &addresses[current],
+        messages[current].msg_hdr.msg_namelen);
+    senderLength = messages[current].msg_hdr.msg_namelen;
+    if (messages[current].msg_hdr.msg_flags & MSG_TRUNC)
+        error("%s: Datagram longer than %" Z "u bytes truncated\n",
+            name, datagramSize);
+    debug("UdpPort::receive(%s): datagram %d of %d, %" Z "u bytes \"%s\"\n",
+        name, current + 1, received, inputEnd,
+        StreamBuffer(input, inputEnd).expand()());
+    return true;
+}
+
+// The client which consumes input:
+// the lock owner or, if the port is free, the first synchronous reader.
+EpollInterface* EpollPort::
+primaryReader()
+{
+    EpollInterface* client;
+
+    if (owner) return owner->ioAction == EpollInterface::Read ? owner : NULL;
+    for (client = clients; client; client = client->nextClient)
+        if (client->ioAction == EpollInterface::Read) return client;
+    return NULL;
+}
+
+bool EpollPort::
+wantsInput()
+{
+    EpollInterface* client;
+
+    if (primaryReader()) return true;
+    for (client = clients; client; client = client->nextClient)
+    {
+        if (client->ioAction == EpollInterface::Event) return true;
+        if (client->ioAction == EpollInterface::AsyncRead && !owner)
+            return true;
+    }
+    return false;
+}
+
+// Do one step of work for this port.
+// Return true if a callback was called or the state has changed.
+// Called with epollMutex locked.
+bool EpollPort::
+step(unsigned long long now)
+{
+    EpollInterface* client;
+    EpollInterface* reader;
+
+    if (releasedInCallback)
+    {
+        delete releasedInCallback;
+        releasedInCallback = NULL;
+    }
+
+    // connection handling
+    if (state == Connecting)
+    {
+        if (writable)
+        {
+            int err = connectStatus();
+            if (err == EINPROGRESS)
+            {
+                // stale event from a previous connection
+                writable = false;
+                return false;
+            }
+            finishConnect(now, err);
+            return true;
+        }
+        if (now >= connectDeadline)
+        {
+            finishConnect(now, ETIMEDOUT);
+            return true;
+        }
+    }
+    if (state == Disconnected && !offline && now >= retryTime)
+    {
+        startConnect(now);
+        return true;
+    }
+    if (state == Connected && hangup && !wantsInput())
+    {
+        debug("EpollPort::step(%s): connection lost\n", name);
+        closeFd(now);
+        return true;
+    }
+
+    // pass input to all clients marked for delivery
+    if (deliverSize)
+    {
+        for (client = clients; client; client = client->nextClient)
+        {
+            if (!client->deliver) continue;
+            client->deliver = false;
+            EpollInterface::IoAction action = client->ioAction;
+            client->ioAction = EpollInterface::None;
+            client->gotInput = true;
+            ssize_t more = client->callback(action,
+                datagrams ? StreamIoEnd : StreamIoSuccess,
+                input + inputStart, deliverSize);
+            if (client == releasedInCallback) return true;
+            if (more != 0 && client->ioAction == EpollInterface::None)
+            {
+                // wait for more input
+                client->ioAction = action;
+                client->expectedLength = more > 0 ? more : 0;
+                client->deadline = now + client->readTimeout_ms;
+            }
+            return true;
+        }
+        inputStart += deliverSize;
+        deliverSize = 0;
+        return true;
+    }
+
+    // callbacks for connect requests and re-connect
+    for (client = clients; client; client = client->nextClient)
+    {
+        if (client->ioAction == EpollInterface::Disconnect)
+        {
+            client->ioAction = EpollInterface::None;
+            client->callback(EpollInterface::Disconnect, StreamIoSuccess);
+            return true;
+        }
+        if (client->ioAction == EpollInterface::Connect)
+        {
+            if (state == Connected)
+            {
+                client->ioAction = EpollInterface::None;
+                client->callback(EpollInterface::Connect, StreamIoSuccess);
+                return true;
+            }
+            if (state == Disconnected)
+            {
+                client->ioAction = EpollInterface::None;
+                client->callback(EpollInterface::Connect, StreamIoFault);
+                return true;
+            }
+        }
+        if (client->connectNotify)
+        {
+            client->connectNotify = false;
+            if (client->ioAction != EpollInterface::None || client == owner)
+                continue;
+            client->callback(EpollInterface::Connect, StreamIoSuccess);
+            return true;
+        }
+    }
+
+    // lock requests
+    if (lockQueue)
+    {
+        if (state == Disconnected && now < retryTime)
+        {
+            client = lockQueue;
+            client->removeFromLockQueue();
+            client->callback(EpollInterface::Lock, StreamIoFault);
+            return true;
+        }
+        if (!owner && state == Connected)
+        {
+            client = lockQueue;
+            client->removeFromLockQueue();
+            owner = client;
+            client->callback(EpollInterface::Lock, StreamIoSuccess);
+            return true;
+        }
+    }
+
+    // write
+    if (owner && owner->ioAction == EpollInterface::Write)
+    {
+        client = owner;
+        if (state == Disconnected)
+        {
+            // device may have come back, try once
+            if (!client->flushPending || offline)
+            {
+                client->ioAction = EpollInterface::None;
+                client->callback(EpollInterface::Write, StreamIoFault);
+                return true;
+            }
+            client->flushPending = false;
+            startConnect(now);
+            return true;
+        }
+        if (state == Connected)
+        {
+            if (client->flushPending)
+            {
+                client->flushPending = false;
+                if (client->flushInput()) flush();
+            }
+            while (client->outputSize && writable)
+            {
+                ssize_t written = sendBytes(client->output,
+                    client->outputSize);
+                if (written < 0)
+                {
+                    if (errno == EAGAIN)
+                    {
+                        writable = false;
+                        break;
+                    }
+                    error("%s: Write error to %s: %s\n",
+                        name, target, strerror(errno));
+                    closeFd(now);
+                    client->ioAction = EpollInterface::None;
+                    client->callback(EpollInterface::Write, StreamIoFault);
+                    return true;
+                }
+                debug("EpollPort::step(%s): written %" Z "d bytes \"%s\"\n",
+                    name, written,
+                    StreamBuffer(client->output, written).expand()());
+                client->output += written;
+                client->outputSize -= written;
+            }
+            if (!client->outputSize)
+            {
+                client->ioAction = EpollInterface::None;
+                client->callback(EpollInterface::Write, StreamIoSuccess);
+                return true;
+            }
+        }
+        if (now >= client->deadline)
+        {
+            client->ioAction = EpollInterface::None;
+            client->callback(EpollInterface::Write, StreamIoTimeout);
+            return true;
+        }
+    }
+
+    // input
+    if (inputStart == inputEnd && state == Connected && readable
+        && wantsInput())
+    {
+        if (receive(now)) return true;
+    }
+    if (inputStart < inputEnd)
+    {
+        for (client = clients; client; client = client->nextClient)
+        {
+            if (client->ioAction == EpollInterface::Event)
+            {
+                client->ioAction = EpollInterface::None;
+                client->callback(EpollInterface::Event, StreamIoSuccess);
+                return true;
+            }
+        }
+        reader = primaryReader();
+        if (reader || !owner)
+        {
+            // split input after the terminator of the primary reader
+            // or of the first asynchronous reader
+            size_t size = inputEnd - inputStart;
+            const char* terminator = NULL;
+            size_t termlen = 0;
+            bool receivers = false;
+            for (client = clients; client; client = client->nextClient)
+            {
+                if (client == reader ||
+                    client->ioAction == EpollInterface::AsyncRead)
+                {
+                    client->deliver = true;
+                    receivers = true;
+                    if (!terminator)
+                        terminator = client->getInTerminator(termlen);
+                }
+            }
+            if (reader)
+                terminator = reader->getInTerminator(termlen);
+            // a datagram is always passed on as a whole
+            if (datagrams)
+                termlen = 0;
+            if (terminator && termlen)
+            {
+                const char* end = (const char*)memmem(input + inputStart,
+                    size, terminator, termlen);
+                if (end) size = end + termlen - (input + inputStart);
+            }
+            if (reader && reader->expectedLength > 0 && !datagrams &&
+                (size_t)reader->expectedLength < size)
+                size = reader->expectedLength;
+            if (receivers)
+            {
+                deliverSize = size;
+                return true;
+            }
+        }
+    }
+    else if (state == Disconnected)
+    {
+        // no more input will come
+        for (client = clients; client; client = client->nextClient)
+        {
+            if (client->ioAction == EpollInterface::Event)
+            {
+                client->ioAction = EpollInterface::None;
+                client->callback(EpollInterface::Event, StreamIoFault);
+                return true;
+            }
+        }
+        reader = primaryReader();
+        if (reader)
+        {
+            reader->ioAction = EpollInterface::None;
+            reader->callback(EpollInterface::Read,
+                reader->gotInput ? StreamIoEnd : StreamIoFault);
+            return true;
+        }
+    }
+
+    // timeouts of lock, read and event requests
+    for (client = clients; client; client = client->nextClient)
+    {
+        if (!client->deadline || now < client->deadline) continue;
+        switch (client->ioAction)
+        {
+            case EpollInterface::Lock:
+                client->removeFromLockQueue();
+                client->callback(EpollInterface::Lock, StreamIoTimeout);
+                return true;
+            case EpollInterface::Read:
+            case EpollInterface::AsyncRead:
+            {
+                EpollInterface::IoAction action = client->ioAction;
+                client->ioAction = EpollInterface::None;
+                client->callback(action, client->gotInput ?
+                    StreamIoTimeout : StreamIoNoReply);
+                return true;
+            }
+            case EpollInterface::Event:
+                client->ioAction = EpollInterface::None;
+                client->callback(EpollInterface::Event, StreamIoTimeout);
+                return true;
+            case EpollInterface::Connect:
+                client->ioAction = EpollInterface::None;
+                client->callback(EpollInterface::Connect, StreamIoTimeout);
+                return true;
+            default:
+                break;
+        }
+    }
+    return false;
+}
+
+void EpollPort::
+updateInterest()
+{
+    unsigned int events = 0;
+
+    if (state == Connecting)
+        events = EPOLLOUT;
+    else if (state == Connected)
+    {
+        if (inputStart == inputEnd && wantsInput())
+            events |= EPOLLIN;
+        if (!writable)
+            events |= EPOLLOUT;
+    }
+    if (events == interest || fd < 0) return;
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = this;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) < 0)
+    {
+        error("%s: epoll_ctl failed: %s\n", name, strerror(errno));
+        return;
+    }
+    interest = events;
+}
+
+unsigned long long EpollPort::
+nextDeadline()
+{
+    EpollInterface* client;
+    unsigned long long next = 0;
+
+    if (state == Connecting)
+        next = connectDeadline;
+    else if (state == Disconnected && !offline)
+        next = retryTime;
+    for (client = clients; client; client = client->nextClient)
+    {
+        if (client->ioAction != EpollInterface::None && client->deadline &&
+            (!next || client->deadline < next))
+            next = client->deadline;
+    }
+    return next;
+}
+
+void EpollPort::
+printStatus(StreamBuffer& buffer)
+{
+    static const char* states[] = {"disconnected", "connecting", "connected"};
+    buffer.print("%s %s%s", target, states[state],
+        offline ? " (offline)" : "");
+    if (inputEnd > inputStart)
+        buffer.print(" %" Z "u bytes input", inputEnd - inputStart);
+}
+
+// EpollInterface: one per client
+
+const char* EpollInterface::
+toStr(IoAction action)
+{
+    static const char* names[] = {
+        "None", "Lock", "Write", "Read", "AsyncRead", "Event", "Connect",
+        "Disconnect"};
+    return names[action];
+}
+
+EpollInterface::
+EpollInterface(Client* client, EpollPort* port) :
+    StreamBusInterface(client), port(port), nextClient(NULL),
+    nextLock(NULL), ioAction(None), deadline(0), output(NULL),
+    outputSize(0), flushPending(false), readTimeout_ms(0),
+    expectedLength(0), gotInput(false), deliver(false),
+    connectNotify(false)
+{
+    EpollInterface** pc;
+    epicsMutexMustLock(epollMutex);
+    for (pc = &port->clients; *pc; pc = &(*pc)->nextClient);
+    *pc = this;
+    epicsMutexUnlock(epollMutex);
+}
+
+EpollInterface::
+~EpollInterface()
+{
+}
+
+StreamBusInterface* EpollInterface::
+getBusInterface(Client* client,
+    const char* busname, int addr, const char*)
+{
+    EpollPort* port;
+
+    if (!epollMutex) return NULL;
+    epicsMutexMustLock(epollMutex);
+    port = EpollPort::find(busname);
+    epicsMutexUnlock(epollMutex);
+    if (!port) return NULL;
+    if (addr >= 0)
+    {
+        error("%s: Bus %s has no addresses\n",
+            client->name(), busname);
+        return NULL;
+    }
+    EpollInterface* interface = new EpollInterface(client, port);
+    debug("EpollInterface::getBusInterface(%s): new interface allocated\n",
+        busname);
+    return interface;
+}
+
+// Call the client. Must not hold the mutex because the client
+// may call back any of our methods from another thread.
+ssize_t EpollInterface::
+callback(IoAction action, StreamIoStatus status,
+    const char* input, size_t size)
+{
+    ssize_t more = 0;
+
+    debug("EpollInterface::callback(%s, %s, %s)\n",
+        clientName(), toStr(action), ::toStr(status));
+    deadline = 0;
+    calling = this;
+    epicsMutexUnlock(epollMutex);
+    switch (action)
+    {
+        case Lock:
+            lockCallback(status);
+            break;
+        case Write:
+            writeCallback(status);
+            break;
+        case Read:
+        case AsyncRead:
+            more = readCallback(status, input, size);
+            break;
+        case Event:
+            eventCallback(status);
+            break;
+        case Connect:
+            connectCallback(status);
+            break;
+        case Disconnect:
+            disconnectCallback(status);
+            break;
+        default:
+            break;
+    }
+    epicsMutexMustLock(epollMutex);
+    calling = NULL;
+    return more;
+}
+
+void EpollInterface::
+removeFromLockQueue()
+{
+    EpollInterface** pc;
+    for (pc = &port->lockQueue; *pc; pc = &(*pc)->nextLock)
+    {
+        if (*pc == this)
+        {
+            *pc = nextLock;
+            break;
+        }
+    }
+    nextLock = NULL;
+    if (ioAction == Lock) ioAction = None;
+}
+
+bool EpollInterface::
+lockRequest(unsigned long lockTimeout_ms)
+{
+    EpollInterface** pc;
+    long prio = priority();
+
+    debug("EpollInterface::lockRequest(%s, %ld msec)\n",
+        clientName(), lockTimeout_ms);
+    epicsMutexMustLock(epollMutex);
+    if (port->state == EpollPort::Disconnected &&
+        (port->offline || now_ms() < port->retryTime))
+    {
+        epicsMutexUnlock(epollMutex);
+        debug("EpollInterface::lockRequest(%s): %s is disconnected\n",
+            clientName(), port->name);
+        return false;
+    }
+    ioAction = Lock;
+    deadline = lockTimeout_ms ? now_ms() + lockTimeout_ms : 0;
+    // higher priority clients first, same priority in order of request
+    for (pc = &port->lockQueue; *pc; pc = &(*pc)->nextLock)
+        if ((*pc)->priority() < prio) break;
+    nextLock = *pc;
+    *pc = this;
+    epicsMutexUnlock(epollMutex);
+    wakeThread();
+    return true;
+    // continues with lockCallback() from the I/O thread
+}
+
+bool EpollInterface::
+unlock()
+{
+    debug("EpollInterface::unlock(%s)\n", clientName());
+    epicsMutexMustLock(epollMutex);
+    if (port->owner == this)
+    {
+        port->owner = NULL;
+        if (port->lockQueue) wakeThread();
+    }
+    epicsMutexUnlock(epollMutex);
+    return true;
+}
+
+bool EpollInterface::
+writeRequest(const void* output, size_t size, unsigned long writeTimeout_ms)
+{
+    debug("EpollInterface::writeRequest(%s, \"%s\", %ld msec)\n",
+        clientName(), StreamBuffer(output, size).expand()(),
+        writeTimeout_ms);
+    epicsMutexMustLock(epollMutex);
+    if (port->owner != this)
+    {
+        epicsMutexUnlock(epollMutex);
+        error("%s: writeRequest without lock\n", clientName());
+        return false;
+    }
+    this->output = static_cast<const char*>(output);
+    outputSize = size;
+    // flushPending also allows one re-connect when the device is gone
+    flushPending = true;
+    ioAction = Write;
+    deadline = now_ms() + writeTimeout_ms;
+    epicsMutexUnlock(epollMutex);
+    wakeThread();
+    return true;
+    // continues with writeCallback() from the I/O thread
+}
+
+bool EpollInterface::
+readRequest(unsigned long replyTimeout_ms, unsigned long readTimeout_ms,
+    ssize_t expectedLength, bool async)
+{
+    debug("EpollInterface::readRequest(%s, %ld msec reply, %ld msec read, expect %" Z "d bytes, async=%s)\n",
+        clientName(), replyTimeout_ms, readTimeout_ms, expectedLength,
+        async ? "yes" : "no");
+    epicsMutexMustLock(epollMutex);
+    ioAction = async ? AsyncRead : Read;
+    this->readTimeout_ms = readTimeout_ms;
+    this->expectedLength = expectedLength;
+    gotInput = false;
+    deadline = now_ms() + replyTimeout_ms;
+    epicsMutexUnlock(epollMutex);
+    wakeThread();
+    return true;
+    // continues with readCallback() from the I/O thread
+}
+
+bool EpollInterface::
+supportsEvent()
+{
+    return true;
+}
+
+bool EpollInterface::
+supportsAsyncRead()
+{
+    return true;
+}
+
+// Sockets and serial lines have no events like a GPIB SRQ.
+// Here an event means: input is available. The input is not consumed.
+bool EpollInterface::
+acceptEvent(unsigned long, unsigned long timeout_ms)
+{
+    debug("EpollInterface::acceptEvent(%s, %ld msec)\n",
+        clientName(), timeout_ms);
+    epicsMutexMustLock(epollMutex);
+    ioAction = Event;
+    deadline = timeout_ms ? now_ms() + timeout_ms : 0;
+    epicsMutexUnlock(epollMutex);
+    wakeThread();
+    return true;
+}
+
+bool EpollInterface::
+connectRequest(unsigned long connecttimeout_ms)
+{
+    debug("EpollInterface::connectRequest(%s, %ld msec)\n",
+        clientName(), connecttimeout_ms);
+    epicsMutexMustLock(epollMutex);
+    ioAction = Connect;
+    deadline = now_ms() + connecttimeout_ms;
+    if (port->state == EpollPort::Disconnected)
+    {
+        port->offline = false;
+        port->retryTime = 0;
+    }
+    epicsMutexUnlock(epollMutex);
+    wakeThread();
+    return true;
+}
+
+bool EpollInterface::
+disconnectRequest()
+{
+    debug("EpollInterface::disconnectRequest(%s)\n", clientName());
+    epicsMutexMustLock(epollMutex);
+    port->offline = true;
+    if (port->state != EpollPort::Disconnected)
+        port->closeFd(now_ms());
+    ioAction = Disconnect;
+    deadline = 0;
+    epicsMutexUnlock(epollMutex);
+    wakeThread();
+    return true;
+    // continues with disconnectCallback() from the I/O thread
+}
+
+void EpollInterface::
+finish()
+{
+    debug("EpollInterface::finish(%s)\n", clientName());
+    epicsMutexMustLock(epollMutex);
+    removeFromLockQueue();
+    ioAction = None;
+    deadline = 0;
+    deliver = false;
+    epicsMutexUnlock(epollMutex);
+}
+
+void EpollInterface::
+release()
+{
+    EpollInterface** pc;
+
+    debug("EpollInterface::release(%s)\n", clientName());
+    epicsMutexMustLock(epollMutex);
+    removeFromLockQueue();
+    if (port->owner == this) port->owner = NULL;
+    for (pc = &port->clients; *pc; pc = &(*pc)->nextClient)
+    {
+        if (*pc == this)
+        {
+            *pc = nextClient;
+            break;
+        }
+    }
+    ioAction = None;
+    if (calling == this)
+    {
+        if (epicsThreadGetIdSelf() == epollThreadId)
+        {
+            // released from its own callback: delete afterwards
+            releasedInCallback = this;
+            epicsMutexUnlock(epollMutex);
+            return;
+        }
+        while (calling == this)
+        {
+            epicsMutexUnlock(epollMutex);
+            epicsThreadSleep(0.001);
+            epicsMutexMustLock(epollMutex);
+        }
+    }
+    epicsMutexUnlock(epollMutex);
+    wakeThread();
+    delete this;
+}
+
+void EpollInterface::
+printStatus(StreamBuffer& buffer)
+{
+    epicsMutexMustLock(epollMutex);
+    port->printStatus(buffer);
+    if (port->owner == this)
+        buffer.append(" owner");
+    if (ioAction != None)
+        buffer.print(" %s", toStr(ioAction));
+    epicsMutexUnlock(epollMutex);
+}
+
+// iocsh commands to configure ports
+
+bool EpollPort::
+add(EpollPort* port)
+{
+    if (!epollMutex)
+    {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0)
+        {
+            error("%s: Cannot create epoll: %s\n",
+                port->name, strerror(errno));
+            if (epollFd >= 0) close(epollFd);
+            if (wakeFd >= 0) close(wakeFd);
+            epollFd = wakeFd = -1;
+            return false;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+        epollMutex = epicsMutexMustCreate();
+    }
+    epicsMutexMustLock(epollMutex);
+    if (find(port->name))
+    {
+        epicsMutexUnlock(epollMutex);
+        error("%s: Port already exists\n", port->name);
+        return false;
+    }
+    port->next = first;
+    first = port;
+    epicsMutexUnlock(epollMutex);
+
+    if (!epollThreadId)
+    {
+        epollThreadId = epicsThreadCreate("streamEpoll",
+            epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackMedium),
+            epollThread, NULL);
+    }
+    else wakeThread();
+    return true;
+}
+
+// Resolve host:port, report errors as "command name: ..."
+static struct addrinfo* resolve(const char* command, const char* name,
+    const char* hostport, int socktype)
+{
+    char host[256];
+    const char* service;
+    struct addrinfo hints, *res;
+    int status;
+
+    service = strrchr(hostport, ':');
+    if (!service || service == hostport ||
+        (size_t)(service - hostport) >= sizeof(host))
+    {
+        error("%s %s: %s is not host:port\n",
+            command, name, hostport);
+        return NULL;
+    }
+    memcpy(host, hostport, service - hostport);
+    host[service - hostport] = 0;
+    service++;
+    // allow [address] for IPv6
+    if (host[0] == '[' && host[strlen(host)-1] == ']')
+    {
+        memmove(host, host+1, strlen(host));
+        host[strlen(host)-1] = 0;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = socktype;
+    status = getaddrinfo(host, service, &hints, &res);
+    if (status != 0)
+    {
+        error("%s %s: %s: %s\n",
+            command, name, hostport, gai_strerror(status));
+        return NULL;
+    }
+    return res;
+}
+
+static void streamTcpConfigure(const char* name, const char* hostport)
+{
+    struct addrinfo *res;
+    EpollPort* port;
+
+    if (!name || !*name || !hostport || !*hostport)
+    {
+        fprintf(stderr, "usage: streamTcpConfigure name host:port\n");
+        return;
+    }
+    res = resolve("streamTcpConfigure", name, hostport, SOCK_STREAM);
+    if (!res) return;
+    port = new TcpPort(name, hostport, res);
+    freeaddrinfo(res);
+    if (!EpollPort::add(port)) delete port;
+}
+
+static void streamUdpConfigure(const char* name, const char* destinationList,
+    int localPort)
+{
+    char hostport[300];
+    const char* p;
+    size_t len;
+    int count = 0, i;
+    int family = 0;
+    struct addrinfo** res = NULL;
+    EpollPort* port = NULL;
+
+    if (!name || !*name)
+    {
+        fprintf(stderr, "usage: streamUdpConfigure name "
+            "[host:port,...] [localport]\n");
+        return;
+    }
+    if (!destinationList) destinationList = "";
+    if (localPort < 0 || localPort > 65535)
+    {
+        error("streamUdpConfigure %s: Illegal local port %d\n",
+            name, localPort);
+        return;
+    }
+    if (!*destinationList && !localPort)
+    {
+        error("streamUdpConfigure %s: Need destinations or local port\n",
+            name);
+        return;
+    }
+    for (p = destinationList; *p; p++)
+        if (*p == ',') count++;
+    res = new struct addrinfo*[count + 1];
+    count = 0;
+    for (p = destinationList; *p; p += len)
+    {
+        p += strspn(p, ", ");
+        len = strcspn(p, ", ");
+        if (!len) break;
+        if (len >= sizeof(hostport))
+        {
+            error("streamUdpConfigure %s: %.*s is too long\n",
+                name, (int)len, p);
+            goto end;
+        }
+        memcpy(hostport, p, len);
+        hostport[len] = 0;
+        res[count] = resolve("streamUdpConfigure", name, hostport,
+            SOCK_DGRAM);
+        if (!res[count]) goto end;
+        if (family && res[count]->ai_family != family)
+        {
+            error("streamUdpConfigure %s: Cannot mix IPv4 and IPv6 "
+                "destinations\n", name);
+            freeaddrinfo(res[count]);
+            goto end;
+        }
+        family = res[count]->ai_family;
+        count++;
+    }
+    if (!*destinationList)
+    {
+        sprintf(hostport, ":%d", localPort);
+        destinationList = hostport;
+    }
+    port = new UdpPort(name, destinationList, family ? family : AF_INET,
+        localPort, count, res);
+    if (!EpollPort::add(port)) delete port;
+end:
+    for (i = 0; i < count; i++)
+        freeaddrinfo(res[i]);
+    delete[] res;
+}
+
+static const struct {unsigned long baud; speed_t speed;} bauds[] = {
+    {50, B50}, {75, B75}, {110, B110}, {134, B134}, {150, B150},
+    {200, B200}, {300, B300}, {600, B600}, {1200, B1200},
+    {1800, B1800}, {2400, B2400}, {4800, B4800}, {9600, B9600},
+    {19200, B19200}, {38400, B38400}, {57600, B57600},
+    {115200, B115200}, {230400, B230400}, {460800, B460800},
+    {500000, B500000}, {576000, B576000}, {921600, B921600},
+    {1000000, B1000000}, {1152000, B1152000}, {1500000, B1500000},
+    {2000000, B2000000}, {2500000, B2500000}, {3000000, B3000000},
+    {3500000, B3500000}, {4000000, B4000000}
+};
+
+static void streamSerialConfigure(const char* name, const char* device,
+    int baud, const char* format, const char* flow)
+{
+    speed_t speed = 0;
+    tcflag_t cflag = 0;
+    tcflag_t iflag = 0;
+    size_t i;
+
+    if (!name || !*name || !device || !*device)
+    {
+        fprintf(stderr, "usage: streamSerialConfigure name device "
+            "[baud] [format] [flow]\n"
+            "  baud:   default 9600\n"
+            "  format: data bits, parity (N,E,O), stop bits, default 8N1\n"
+            "  flow:   none, rtscts or xonxoff, default none\n");
+        return;
+    }
+    if (baud <= 0) baud = 9600;
+    for (i = 0; i < sizeof(bauds)/sizeof(bauds[0]); i++)
+        if (bauds[i].baud == (unsigned long)baud) speed = bauds[i].speed;
+    if (!speed)
+    {
+        error("streamSerialConfigure %s: Unsupported baud rate %d\n",
+            name, baud);
+        return;
+    }
+    if (!format || !*format) format = "8N1";
+    if (strlen(format) != 3 ||
+        format[0] < '5' || format[0] > '8' ||
+        !strchr("NEOneo", format[1]) ||
+        format[2] < '1' || format[2] > '2')
+    {
+        error("streamSerialConfigure %s: Illegal format %s "
+            "(expect something like 8N1)\n", name, format);
+        return;
+    }
+    switch (format[0])
+    {
+        case '5': cflag |= CS5; break;
+        case '6': cflag |= CS6; break;
+        case '7': cflag |= CS7; break;
+        case '8': cflag |= CS8; break;
+    }
+    switch (format[1])
+    {
+        case 'E': case 'e': cflag |= PARENB; break;
+        case 'O': case 'o': cflag |= PARENB|PARODD; break;
+    }
+    if (format[2] == '2') cflag |= CSTOPB;
+    if (!flow || !*flow || strcmp(flow, "none") == 0)
+        ;
+    else if (strcmp(flow, "rtscts") == 0)
+        cflag |= CRTSCTS;
+    else if (strcmp(flow, "xonxoff") == 0)
+        iflag |= IXON|IXOFF;
+    else
+    {
+        error("streamSerialConfigure %s: Illegal flow control %s "
+            "(expect none, rtscts or xonxoff)\n", name, flow);
+        return;
+    }
+    EpollPort* port = new SerialPort(name, device, speed, cflag, iflag);
+    if (!EpollPort::add(port)) delete port;
+}
+
+static const iocshArg streamTcpConfigureArg0 =
+    { "name", iocshArgString };
+static const iocshArg streamTcpConfigureArg1 =
+    { "host:port", iocshArgString };
+static const iocshArg * const streamTcpConfigureArgs[] =
+    { &streamTcpConfigureArg0, &streamTcpConfigureArg1 };
+static const iocshFuncDef streamTcpConfigureDef =
+    { "streamTcpConfigure", 2, streamTcpConfigureArgs };
+
+static void streamTcpConfigureFunc(const iocshArgBuf *args)
+{
+    streamTcpConfigure(args[0].sval, args[1].sval);
+}
+
+static const iocshArg streamSerialConfigureArg0 =
+    { "name", iocshArgString };
+static const iocshArg streamSerialConfigureArg1 =
+    { "device", iocshArgString };
+static const iocshArg streamSerialConfigureArg2 =
+    { "[baud]", iocshArgInt };
+static const iocshArg streamSerialConfigureArg3 =
+    { "[format]", iocshArgString };
+static const iocshArg streamSerialConfigureArg4 =
+    { "[flow]", iocshArgString };
+static const iocshArg * const streamSerialConfigureArgs[] =
+    { &streamSerialConfigureArg0, &streamSerialConfigureArg1,
+      &streamSerialConfigureArg2, &streamSerialConfigureArg3,
+      &streamSerialConfigureArg4 };
+static const iocshFuncDef streamSerialConfigureDef =
+    { "streamSerialConfigure", 5, streamSerialConfigureArgs };
+
+static void streamSerialConfigureFunc(const iocshArgBuf *args)
+{
+    streamSerialConfigure(args[0].sval, args[1].sval, args[2].ival,
+        args[3].sval, args[4].sval);
+}
+
+static const iocshArg streamUdpConfigureArg0 =
+    { "name", iocshArgString };
+static const iocshArg streamUdpConfigureArg1 =
+    { "[host:port,...]", iocshArgString };
+static const iocshArg streamUdpConfigureArg2 =
+    { "[localport]", iocshArgInt };
+static const iocshArg * const streamUdpConfigureArgs[] =
+    { &streamUdpConfigureArg0, &streamUdpConfigureArg1,
+      &streamUdpConfigureArg2 };
+static const iocshFuncDef streamUdpConfigureDef =
+    { "streamUdpConfigure", 3, streamUdpConfigureArgs };
+
+static void streamUdpConfigureFunc(const iocshArgBuf *args)
+{
+    streamUdpConfigure(args[0].sval, args[1].sval, args[2].ival);
+}
+
+// Register the commands when the library is loaded.
+// A registrar() in stream.dbd would not work on architectures
+// which share the dbd file but do not build this interface.
+static struct EpollInterfaceIocshRegistrar
+{
+    EpollInterfaceIocshRegistrar()
+    {
+        iocshRegister(&streamTcpConfigureDef, streamTcpConfigureFunc);
+        iocshRegister(&streamSerialConfigureDef, streamSerialConfigureFunc);
+        iocshRegister(&streamUdpConfigureDef, streamUdpConfigureFunc);
+    }
+} epollInterfaceIocshRegistrar;
@@ -30,6 +30,12 @@ class RawConverter : public StreamFormatConverter
     int parse(const StreamFormat&, StreamBuffer&, const char*&, bool);
     bool printLong(const StreamFormat&, StreamBuffer&, long);
     ssize_t scanLong(const StreamFormat&, const char*, long&);
+    bool printArray(const StreamFormat&, StreamBuffer&,
+        const StreamBuffer&, const void*, StreamArrayType, size_t);
+    ssize_t scanArray(const StreamFormat&, const char*, size_t,
+        const StreamBuffer&, void*, StreamArrayType, size_t&);
+    static bool print(const StreamFormat&, StreamBuffer&, long);
+    static ssize_t scan(const StreamFormat&, const char*, long&);
 };
 
 int RawConverter::
@@ -41,6 +47,95 @@ parse(const StreamFormat& fmt, StreamBuffer&,
 
 bool RawConverter::
 printLong(const StreamFormat& fmt, StreamBuffer& output, long value)
+{
+    return print(fmt, output, value);
+}
+
+ssize_t RawConverter::
+scanLong(const StreamFormat& fmt, const char* input, long& value)
+{
+    return scan(fmt, input, value);
+}
+
+bool RawConverter::
+printArray(const StreamFormat& fmt, StreamBuffer& output,
+    const StreamBuffer& separator, const void* values,
+    StreamArrayType type, size_t count)
+{
+    size_t prec = fmt.prec < 0 ? 1 : fmt.prec;
+    size_t size = elementSize(type);
+
+    if (!separator && prec == size && fmt.width <= prec
+        && type != float32_array && type != float64_array)
+    {
+        copySwapped(output.reserve(count * size),
+            static_cast<const char*>(values), count, size,
+            !(fmt.flags & alt_flag) == hostIsLittleEndian());
+        return true;
+    }
+    return printElements<long>(print, fmt, output,
+        separator, values, type, count);
+}
+
+// Sign or zero extend 1 or 2 byte raw values to wider array elements
+template <class T>
+static void widen(T* values, const char* input, size_t count,
+    size_t width, bool littleEndian, bool zeroFill)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(input);
+    unsigned long sign = 0x80UL << 8 * (width-1);
+    unsigned long v;
+    size_t i;
+
+    for (i = 0; i < count; i++, p += width)
+    {
+        if (width == 1) v = p[0];
+        else if (littleEndian) v = p[0] | p[1] << 8;
+        else v = p[0] << 8 | p[1];
+        if (!zeroFill) v = (v ^ sign) - sign;
+        values[i] = static_cast<T>(v);
+    }
+}
+
+ssize_t RawConverter::
+scanArray(const StreamFormat& fmt, const char* input, size_t length,
+    const StreamBuffer& separator, void* values,
+    StreamArrayType type, size_t& count)
+{
+    size_t width = fmt.width ? fmt.width : 1;
+    size_t size = elementSize(type);
+    bool littleEndian = fmt.flags & alt_flag;
+
+    // Contiguous block without separators:
+    // decode all elements at once instead of byte by byte.
+    if (!separator && !(fmt.flags & skip_flag)
+        && type != float32_array && type != float64_array)
+    {
+        if (width == size)
+        {
+            if (count > length / width) count = length / width;
+            copySwapped(values, input, count, width,
+                littleEndian != hostIsLittleEndian());
+            return count * width;
+        }
+        if (width < size && width <= 2)
+        {
+            if (count > length / width) count = length / width;
+            if (size == 2)
+                widen(static_cast<short*>(values), input, count,
+                    width, littleEndian, fmt.flags & zero_flag);
+            else
+                widen(static_cast<int*>(values), input, count,
+                    width, littleEndian, fmt.flags & zero_flag);
+            return count * width;
+        }
+    }
+    return scanElements<long>(scan, fmt, input,
+        length, separator, values, type, count);
+}
+
+bool RawConverter::
+print(const StreamFormat& fmt, StreamBuffer& output, long value)
 {
     unsigned int prec = fmt.prec < 0 ? 1 : fmt.prec; // number of bytes from value, default 1
     unsigned long width = prec;  // number of bytes in output
@@ -98,7 +193,7 @@ printLong(const StreamFormat& fmt, StreamBuffer& output, long value)
 }
 
 ssize_t RawConverter::
-scanLong(const StreamFormat& fmt, const char* input, long& value)
+scan(const StreamFormat& fmt, const char* input, long& value)
 {
     ssize_t consumed = 0;
     long val = 0;
@@ -32,6 +32,12 @@ class RawFloatConverter : public StreamFormatConverter
     int parse(const StreamFormat&, StreamBuffer&, const char*&, bool);
     bool printDouble(const StreamFormat&, StreamBuffer&, double);
     ssize_t scanDouble(const StreamFormat&, const char*, double&);
+    bool printArray(const StreamFormat&, StreamBuffer&,
+        const StreamBuffer&, const void*, StreamArrayType, size_t);
+    ssize_t scanArray(const StreamFormat&, const char*, size_t,
+        const StreamBuffer&, void*, StreamArrayType, size_t&);
+    static bool print(const StreamFormat&, StreamBuffer&, double);
+    static ssize_t scan(const StreamFormat&, const char*, double&);
 };
 
 int RawFloatConverter::
@@ -58,6 +64,77 @@ parse(const StreamFormat& format, StreamBuffer&,
 
 bool RawFloatConverter::
 printDouble(const StreamFormat& format, StreamBuffer& output, double value)
+{
+    return print(format, output, value);
+}
+
+ssize_t RawFloatConverter::
+scanDouble(const StreamFormat& format, const char* input, double& value)
+{
+    return scan(format, input, value);
+}
+
+bool RawFloatConverter::
+printArray(const StreamFormat& format, StreamBuffer& output,
+    const StreamBuffer& separator, const void* values,
+    StreamArrayType type, size_t count)
+{
+    size_t nbOfBytes = format.width ? format.width : 4;
+
+    if (!separator && nbOfBytes == elementSize(type) &&
+        (type == float32_array || type == float64_array))
+    {
+        copySwapped(output.reserve(count * nbOfBytes),
+            static_cast<const char*>(values), count, nbOfBytes,
+            !(format.flags & alt_flag) ^ (endian == 4321));
+        return true;
+    }
+    return printElements<double>(print, format, output,
+        separator, values, type, count);
+}
+
+ssize_t RawFloatConverter::
+scanArray(const StreamFormat& format, const char* input, size_t length,
+    const StreamBuffer& separator, void* values,
+    StreamArrayType type, size_t& count)
+{
+    size_t nbOfBytes = format.width ? format.width : 4;
+    bool swap = !(format.flags & alt_flag) ^ (endian == 4321);
+    size_t i;
+
+    // Contiguous block without separators:
+    // decode all elements at once instead of byte by byte.
+    if (!separator && !(format.flags & skip_flag))
+    {
+        if (nbOfBytes == elementSize(type) &&
+            (type == float32_array || type == float64_array))
+        {
+            if (count > length / nbOfBytes) count = length / nbOfBytes;
+            copySwapped(values, input, count, nbOfBytes, swap);
+            return count * nbOfBytes;
+        }
+        if (nbOfBytes == 4 && type == float64_array)
+        {
+            // Decode floats into the upper half of the array,
+            // then widen front to back. Each double is written
+            // only after the float it overlaps has been read.
+            if (count > length / 4) count = length / 4;
+            float* fvals = static_cast<float*>(values) + count;
+            copySwapped(fvals, input, count, 4, swap);
+            for (i = 0; i < count; i++)
+            {
+                double dval = fvals[i];
+                static_cast<double*>(values)[i] = dval;
+            }
+            return count * 4;
+        }
+    }
+    return scanElements<double>(scan, format, input,
+        length, separator, values, type, count);
+}
+
+bool RawFloatConverter::
+print(const StreamFormat& format, StreamBuffer& output, double value)
 {
     int nbOfBytes;
     int n;
@@ -93,7 +170,7 @@ printDouble(const StreamFormat& format, StreamBuffer& output, double value)
 }
 
 ssize_t RawFloatConverter::
-scanDouble(const StreamFormat& format, const char* input, double& value)
+scan(const StreamFormat& format, const char* input, double& value)
 {
     int nbOfBytes;
     int i, n;
@@ -24,7 +24,19 @@
 #include <limits.h>
 #include <ctype.h>
 
+#ifdef USE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include "pcre2.h"
+#else
 #include "pcre.h"
+#endif
+
+#include "epicsVersion.h"
+#ifdef BASE_VERSION
+#define EPICS_3_13
+#else
+#include "epicsMutex.h"
+#endif
 
 #include "StreamFormatConverter.h"
 #include "StreamError.h"
@@ -34,20 +46,253 @@
 // Perl regular expressions (PCRE) %/regexp/ and  %#/regexp/subst/
 
 /* Notes:
- - Memory for compiled regexp is allocated in parse but never freed.
-   This should not be too much of a problem unless streamReload is
-   called really often before the IOC is restarted. It is not a
-   run-time leak.
+ - Compiled patterns are shared by all formats with the same pattern
+   and freed when the last protocol using them is released,
+   e.g. by streamReload. They are JIT compiled if PCRE2 supports it.
+   The legacy PCRE library does not use JIT because its JIT stack
+   would be shared by all formats using the pattern.
+ - The list of patterns is protected by a mutex, because records
+   may be initialized or reloaded by different threads.
+ - Each format has its own match data, because formats of different
+   records may be used concurrently but one format is never used by
+   two threads at the same time.
  - A maximum of 9 subexpressions is supported. Only one of them can
    be the result of the match.
 */
 
+class RegexpPattern
+{
+    static RegexpPattern* list;
+#ifndef EPICS_3_13
+    static epicsMutex listMutex;
+#endif
+    RegexpPattern* next;
+    StreamBuffer source;
+    unsigned int refcount;
+    RegexpPattern(const StreamBuffer& pattern);
+    ~RegexpPattern();
+public:
+#ifdef USE_PCRE2
+    pcre2_code* code;
+#else
+    pcre* code;
+    pcre_extra* extra;
+#endif
+    int captures;
+    static RegexpPattern* get(const StreamBuffer& pattern);
+    void put();
+};
+
+RegexpPattern* RegexpPattern::list = NULL;
+#ifndef EPICS_3_13
+epicsMutex RegexpPattern::listMutex;
+#endif
+
+RegexpPattern::
+RegexpPattern(const StreamBuffer& pattern)
+    : next(list), source(pattern), refcount(1), code(NULL), captures(0)
+{
+#ifdef USE_PCRE2
+    int errorcode;
+    PCRE2_SIZE eoffset;
+    uint32_t nsubexpr;
+
+    code = pcre2_compile((PCRE2_SPTR)pattern(), PCRE2_ZERO_TERMINATED,
+        0, &errorcode, &eoffset, NULL);
+    if (!code)
+    {
+        PCRE2_UCHAR errormsg[120];
+        pcre2_get_error_message(errorcode, errormsg, sizeof(errormsg));
+        error("%s after \"%s\"\n", (char*)errormsg, pattern.expand(0, eoffset)());
+        return;
+    }
+    // without JIT support pcre2_match uses the interpreter
+    errorcode = pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+    debug("pcre2_jit_compile result = %d\n", errorcode);
+    pcre2_pattern_info(code, PCRE2_INFO_CAPTURECOUNT, &nsubexpr);
+    captures = nsubexpr;
+#else
+    const char* errormsg;
+    int eoffset;
+
+    extra = NULL;
+    code = pcre_compile(pattern(), 0, &errormsg, &eoffset, NULL);
+    if (!code)
+    {
+        error("%s after \"%s\"\n", errormsg, pattern.expand(0, eoffset)());
+        return;
+    }
+    extra = pcre_study(code, 0, &errormsg);
+    pcre_fullinfo(code, extra, PCRE_INFO_CAPTURECOUNT, &captures);
+#endif
+    list = this;
+}
+
+RegexpPattern::
+~RegexpPattern()
+{
+#ifdef USE_PCRE2
+    pcre2_code_free(code);
+#else
+#ifdef PCRE_STUDY_JIT_COMPILE
+    pcre_free_study(extra);
+#else
+    pcre_free(extra);
+#endif
+    pcre_free(code);
+#endif
+}
+
+RegexpPattern* RegexpPattern::
+get(const StreamBuffer& pattern)
+{
+    RegexpPattern* p;
+#ifndef EPICS_3_13
+    listMutex.lock();
+#endif
+    for (p = list; p; p = p->next)
+    {
+        if (p->source.length() == pattern.length() &&
+            memcmp(p->source(), pattern(), pattern.length()) == 0)
+        {
+            p->refcount++;
+            debug("regexp \"%s\" used %u times\n", pattern.expand()(), p->refcount);
+            break;
+        }
+    }
+    if (!p)
+    {
+        p = new RegexpPattern(pattern);
+        if (!p->code)
+        {
+            delete p;
+            p = NULL;
+        }
+    }
+#ifndef EPICS_3_13
+    listMutex.unlock();
+#endif
+    return p;
+}
+
+void RegexpPattern::
+put()
+{
+#ifndef EPICS_3_13
+    listMutex.lock();
+#endif
+    if (--refcount == 0)
+    {
+        debug("regexp \"%s\" no longer used\n", source.expand()());
+        RegexpPattern** pp;
+        for (pp = &list; *pp; pp = &(*pp)->next)
+        {
+            if (*pp == this)
+            {
+                *pp = next;
+                break;
+            }
+        }
+        delete this;
+    }
+#ifndef EPICS_3_13
+    listMutex.unlock();
+#endif
+}
+
+class RegexpMatcher
+{
+    RegexpPattern* pattern;
+#ifdef USE_PCRE2
+    pcre2_match_data* matchData;
+    pcre2_match_context* matchContext;
+    pcre2_jit_stack* jitStack;
+    size_t jitStackSize;
+#else
+    int ovec[30];
+    size_t ovecSize[30];
+#endif
+public:
+    RegexpMatcher(RegexpPattern* pattern);
+    ~RegexpMatcher();
+    int match(const char* subject, size_t length);
+    const size_t* ovector();
+};
+
+RegexpMatcher::
+RegexpMatcher(RegexpPattern* pattern)
+    : pattern(pattern)
+{
+#ifdef USE_PCRE2
+    matchData = pcre2_match_data_create_from_pattern(pattern->code, NULL);
+    matchContext = NULL;
+    jitStack = NULL;
+    jitStackSize = 0;
+#endif
+}
+
+RegexpMatcher::
+~RegexpMatcher()
+{
+#ifdef USE_PCRE2
+    pcre2_match_data_free(matchData);
+    pcre2_match_context_free(matchContext);
+    pcre2_jit_stack_free(jitStack);
+#endif
+    pattern->put();
+}
+
+int RegexpMatcher::
+match(const char* subject, size_t length)
+{
+#ifdef USE_PCRE2
+    int rc;
+    while (1)
+    {
+        rc = pcre2_match(pattern->code, (PCRE2_SPTR)subject, length,
+            0, 0, matchData, matchContext);
+        if (rc != PCRE2_ERROR_JIT_STACKLIMIT || jitStackSize >= 8*1024*1024)
+            return rc;
+        // default JIT stack is too small for this pattern and input
+        jitStackSize = jitStackSize ? jitStackSize * 4 : 128*1024;
+        debug("pcre2_match: increasing JIT stack to %" Z "u bytes\n", jitStackSize);
+        pcre2_jit_stack_free(jitStack);
+        jitStack = pcre2_jit_stack_create(32*1024, jitStackSize, NULL);
+        if (!matchContext)
+            matchContext = pcre2_match_context_create(NULL);
+        if (!jitStack || !matchContext)
+            return rc;
+        pcre2_jit_stack_assign(matchContext, NULL, jitStack);
+    }
+#else
+    int rc, i;
+    if (length > INT_MAX)
+        length = INT_MAX;
+    rc = pcre_exec(pattern->code, pattern->extra, subject, (int)length,
+        0, 0, ovec, 30);
+    for (i = 0; i < 20; i++)
+        ovecSize[i] = ovec[i];
+    return rc;
+#endif
+}
+
+inline const size_t* RegexpMatcher::
+ovector()
+{
+#ifdef USE_PCRE2
+    return pcre2_get_ovector_pointer(matchData);
+#else
+    return ovecSize;
+#endif
+}
+
 class RegexpConverter : public StreamFormatConverter
 {
     int parse (const StreamFormat& fmt, StreamBuffer&, const char*&, bool);
     ssize_t scanString(const StreamFormat& fmt, const char*, char*, size_t&);
     ssize_t scanPseudo(const StreamFormat& fmt, StreamBuffer& input, size_t& cursor);
     bool printPseudo(const StreamFormat& fmt, StreamBuffer& output);
+    void release(const StreamFormat& fmt);
 };
 
 int RegexpConverter::
@@ -89,23 +334,17 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
     source++;
     debug("regexp = \"%s\"\n", pattern.expand()());
 
-    const char* errormsg;
-    int eoffset;
-    int nsubexpr;
-
-    pcre* code = pcre_compile(pattern(), 0, &errormsg, &eoffset, NULL);
+    RegexpPattern* code = RegexpPattern::get(pattern);
     if (!code)
-    {
-        error("%s after \"%s\"\n", errormsg, pattern.expand(0, eoffset)());
         return false;
-    }
-    pcre_fullinfo(code, NULL, PCRE_INFO_CAPTURECOUNT, &nsubexpr);
-    if (fmt.prec > nsubexpr)
+    if (fmt.prec > code->captures)
     {
-        error("Sub-expression index is %ld but pattern has only %d sub-expression\n", fmt.prec, nsubexpr);
+        error("Sub-expression index is %ld but pattern has only %d sub-expression\n", fmt.prec, code->captures);
+        code->put();
         return false;
     }
-    info.append(&code, sizeof(code));
+    RegexpMatcher* matcher = new RegexpMatcher(code);
+    info.append(&matcher, sizeof(matcher));
 
     if (fmt.flags & alt_flag)
     {
@@ -116,6 +355,7 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
         {
             if (!*source) {
                 error("Missing closing '/' after %%#/%s/%s format conversion\n", pattern(), subst());
+                delete matcher;
                 return false;
             }
             if (*source == esc)
@@ -134,21 +374,19 @@ ssize_t RegexpConverter::
 scanString(const StreamFormat& fmt, const char* input,
     char* value, size_t& size)
 {
-    int ovector[30];
     int rc;
     size_t l;
     const char* info = fmt.info;
-    pcre* code = extract<pcre*>(info);
+    RegexpMatcher* matcher = extract<RegexpMatcher*>(info);
     size_t length = fmt.width > 0 ? fmt.width : strlen(input);
     int subexpr = fmt.prec > 0 ? fmt.prec : 0;
 
-    if (length > INT_MAX)
-        length = INT_MAX;
     debug("input = \"%s\"\n", input);
     debug("length=%" Z "u\n", length);
 
-    rc = pcre_exec(code, NULL, input, (int)length, 0, 0, ovector, 30);
-    debug("pcre_exec match \"%.*s\" result = %d\n", (int)length, input, rc);
+    rc = matcher->match(input, length);
+    const size_t* ovector = matcher->ovector();
+    debug("regexp match \"%.*s\" result = %d\n", (int)length, input, rc);
     if ((subexpr && rc <= subexpr) || rc < 0)
     {
         // error or no match or not enough sub-expressions
@@ -172,20 +410,25 @@ scanString(const StreamFormat& fmt, const char* input,
     return ovector[1]; // consume input until end of match
 }
 
+void RegexpConverter::
+release(const StreamFormat& fmt)
+{
+    const char* info = fmt.info;
+    delete extract<RegexpMatcher*>(info);
+}
+
 static void regsubst(const StreamFormat& fmt, StreamBuffer& buffer, size_t start)
 {
     const char* subst = fmt.info;
-    pcre* code = extract<pcre*>(subst);
+    RegexpMatcher* matcher = extract<RegexpMatcher*>(subst);
+    const size_t* ovector;
     size_t length, c;
     int rc, l, r, rl, n;
-    int ovector[30];
     StreamBuffer s;
 
     length = buffer.length() - start;
     if (fmt.width && fmt.width < length)
         length = fmt.width;
-    if (length > INT_MAX)
-        length = INT_MAX;
     if (fmt.flags & left_flag)
         start = buffer.length() - length;
 
@@ -194,12 +437,13 @@ static void regsubst(const StreamFormat& fmt, StreamBuffer& buffer, size_t start
 
     for (c = 0, n = 1; c < length; n++)
     {
-        rc = pcre_exec(code, NULL, buffer(start+c), (int)(length-c), 0, 0, ovector, 30);
-        debug("pcre_exec match \"%s\" result = %d\n", buffer.expand(start+c, length-c)(), rc);
+        rc = matcher->match(buffer(start+c), length-c);
+        ovector = matcher->ovector();
+        debug("regexp match \"%s\" result = %d\n", buffer.expand(start+c, length-c)(), rc);
 
         if (rc < 0) // no match
         {
-            debug("pcre_exec: no match\n");
+            debug("regexp: no match\n");
             break;
         }
         l = ovector[1] - ovector[0];
@@ -211,7 +455,7 @@ static void regsubst(const StreamFormat& fmt, StreamBuffer& buffer, size_t start
         if ((fmt.flags & sign_flag) || n >= fmt.prec)
         {
             // replace subexpressions
-            debug("before [%d]= \"%s\"\n", ovector[0], buffer.expand(start+c,ovector[0])());
+            debug("before [%d]= \"%s\"\n", (int)ovector[0], buffer.expand(start+c,ovector[0])());
             debug("match  [%d]= \"%s\"\n", l, buffer.expand(start+c+ovector[0],l)());
             for (r = 1; r < rc; r++)
                 debug("sub%d = \"%s\"\n", r, buffer.expand(start+c+ovector[r*2], ovector[r*2+1]-ovector[r*2])());
@@ -287,16 +531,16 @@ static void regsubst(const StreamFormat& fmt, StreamBuffer& buffer, size_t start
         c += ovector[0];
         if (l == 0)
         {
-            debug("pcre_exec: empty match\n");
+            debug("regexp: empty match\n");
             c++; // Empty strings may lead to an endless loop. Match them only once.
         }
         if (n == fmt.prec) // max match reached
         {
-            debug("pcre_exec: max match %d reached\n", n);
+            debug("regexp: max match %d reached\n", n);
             break;
         }
     }
-    debug("pcre_exec converted string: %s\n", buffer.expand()());
+    debug("regexp converted string: %s\n", buffer.expand()());
 }
 
 ssize_t RegexpConverter::
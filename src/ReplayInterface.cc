@@ -0,0 +1,911 @@
+/*************************************************************************
+* This is a bus interface for StreamDevice which replays recorded
+* device traffic from a trace file and which records such traces.
+* Please see ../docs/ for detailed documentation.
+*
+* This file is part of StreamDevice.
+*
+* StreamDevice is free software: You can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* StreamDevice is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with StreamDevice. If not, see https://www.gnu.org/licenses/.
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "epicsMutex.h"
+#include "epicsTime.h"
+#include "epicsTimer.h"
+
+#include "StreamBusInterface.h"
+#include "StreamError.h"
+#include "StreamBuffer.h"
+
+#define Z PRINTF_SIZE_T_PREFIX
+
+// Bus names:
+//   replay:file        replay the trace as fast as possible
+//   replaytimed:file   replay the input with the recorded timing
+//   capture:file:bus   use bus and append its traffic to the trace file
+//
+// Trace file format, one transfer per line:
+//   [seconds] > bytes   output written to the device
+//   [seconds] < bytes   input received from the device
+//   [seconds] <| bytes  input with end of message flag from the bus
+// The optional time is relative to the start of the capture.
+// Escape sequences \r \n \t \\ \xHH and \0 are used for special bytes.
+// Lines starting with # are comments.
+//
+// The replay bus is non-blocking like the DebugInterface:
+// All callbacks are called immediately. In timed mode, input which is
+// not due yet is passed later from the timer thread of the client.
+// All clients of the same file share one position
+// in the trace. Output is compared with the next output line.
+// Input lines before an output line are skipped when the protocol
+// flushes input. The trace starts over when it is used up.
+// One client at a time owns the trace from lock to unlock, so that
+// the traffic of one protocol run is not mixed with others.
+// Waiting clients are queued and get the lock in order of request.
+
+static void escapeBytes(StreamBuffer& line, const char* bytes, size_t size)
+{
+    size_t i;
+    unsigned char c;
+
+    for (i = 0; i < size; i++)
+    {
+        c = bytes[i];
+        switch (c)
+        {
+            case '\r': line.append("\\r"); break;
+            case '\n': line.append("\\n"); break;
+            case '\t': line.append("\\t"); break;
+            case '\\': line.append("\\\\"); break;
+            case '\0': line.append("\\0"); break;
+            default:
+                if (c < 0x20 || c >= 0x7f) line.print("\\x%02x", c);
+                else line.append(c);
+        }
+    }
+}
+
+class ReplayInterface;
+
+// A trace file, shared by all clients which replay it
+
+class ReplayTrace
+{
+public:
+    struct Entry
+    {
+        char direction;   // '<' input, '>' output
+        bool end;         // input with end of message flag
+        double time;      // seconds, < 0 if not recorded
+        size_t offset;    // bytes in data
+        size_t size;
+        size_t line;      // line number in file for messages
+    };
+
+    static ReplayTrace* first;
+    ReplayTrace* next;
+    char* filename;
+    StreamBuffer data;
+    Entry* entries;
+    size_t count;
+    size_t position;
+    epicsMutexId mutex;      // protects position and counters
+    epicsMutexId lockMutex;  // protects lockOwner and lockQueue
+    ReplayInterface* lockOwner;
+    ReplayInterface* lockQueue;
+    epicsTimeStamp startTime;
+    double firstTime;
+    unsigned long loops;
+    unsigned long replayed;
+    unsigned long mismatches;
+
+    ReplayTrace(const char* filename);
+    ~ReplayTrace();
+    bool read();
+    static ReplayTrace* get(const char* filename);
+    void rewind();
+    const char* bytes(const Entry* entry)
+        { return data(entry->offset); }
+};
+
+ReplayTrace* ReplayTrace::first;
+
+ReplayTrace::
+ReplayTrace(const char* filename) :
+    next(NULL), entries(NULL), count(0), position(0),
+    lockOwner(NULL), lockQueue(NULL), firstTime(-1.0), loops(0), replayed(0), mismatches(0)
+{
+    this->filename = new char[strlen(filename) + 1];
+    strcpy(this->filename, filename);
+    mutex = epicsMutexMustCreate();
+    lockMutex = epicsMutexMustCreate();
+}
+
+ReplayTrace::
+~ReplayTrace()
+{
+    delete[] filename;
+    delete[] entries;
+    epicsMutexDestroy(mutex);
+    epicsMutexDestroy(lockMutex);
+}
+
+bool ReplayTrace::
+read()
+{
+    FILE* file;
+    StreamBuffer text;
+    char buffer[4096];
+    size_t n, i, lineno;
+    const char* p;
+    const char* end;
+    char* q;
+    Entry entry;
+    size_t allocated = 0;
+
+    file = fopen(filename, "rb");
+    if (!file)
+    {
+        error("Can't open trace file '%s'\n", filename);
+        return false;
+    }
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, n);
+    fclose(file);
+
+    p = text();
+    end = p + text.length();
+    for (lineno = 1; p < end; lineno++)
+    {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        while (p < eol && isspace((unsigned char)*p)) p++;
+        if (p == eol || *p == '#')
+        {
+            p = eol + 1;
+            continue;
+        }
+        entry.time = -1.0;
+        if (isdigit((unsigned char)*p) || *p == '.')
+        {
+            entry.time = strtod(p, &q);
+            p = q;
+            while (p < eol && *p == ' ') p++;
+        }
+        if (p == eol || (*p != '<' && *p != '>'))
+        {
+            error("%s line %" Z "u: Expect < or > at start of line\n",
+                filename, lineno);
+            return false;
+        }
+        entry.direction = *p++;
+        entry.end = entry.direction == '<' && p < eol && *p == '|';
+        if (entry.end) p++;
+        if (p < eol && *p == ' ') p++;
+        entry.offset = data.length();
+        entry.line = lineno;
+        for (; p < eol; p++)
+        {
+            if (*p == '\r' && p + 1 == eol) break;
+            if (*p != '\\' || p + 1 == eol)
+            {
+                data.append(*p);
+                continue;
+            }
+            switch (*++p)
+            {
+                case 'r': data.append('\r'); break;
+                case 'n': data.append('\n'); break;
+                case 't': data.append('\t'); break;
+                case '0': data.append('\0'); break;
+                case 'x':
+                {
+                    char hex[3] = {0};
+                    for (i = 0; i < 2 && p + 1 < eol; i++) hex[i] = *++p;
+                    data.append((char)strtoul(hex, NULL, 16));
+                    break;
+                }
+                default: data.append(*p);
+            }
+        }
+        entry.size = data.length() - entry.offset;
+        if (count == allocated)
+        {
+            allocated = allocated ? 2 * allocated : 64;
+            Entry* e = new Entry[allocated];
+            if (count) memcpy(e, entries, count * sizeof(Entry));
+            delete[] entries;
+            entries = e;
+        }
+        if (firstTime < 0) firstTime = entry.time;
+        entries[count++] = entry;
+        p = eol + 1;
+    }
+    debug("ReplayTrace::read(%s): %" Z "u lines\n", filename, count);
+    return true;
+}
+
+ReplayTrace* ReplayTrace::
+get(const char* filename)
+{
+    ReplayTrace* trace;
+
+    // called during iocInit, before any I/O
+    for (trace = first; trace; trace = trace->next)
+        if (strcmp(trace->filename, filename) == 0) break;
+    if (!trace)
+    {
+        trace = new ReplayTrace(filename);
+        if (trace->read())
+        {
+            trace->next = first;
+            first = trace;
+        }
+        else
+        {
+            delete trace;
+            trace = NULL;
+        }
+    }
+    return trace;
+}
+
+void ReplayTrace::
+rewind()
+{
+    position = 0;
+    loops++;
+    epicsTimeGetCurrent(&startTime);
+}
+
+// ReplayInterface: one per client
+
+class ReplayInterface : StreamBusInterface, epicsTimerNotify
+{
+    ReplayTrace* trace;
+    bool timed;
+    ReplayInterface* nextLock;
+    bool lockWaiting;   // in trace->lockQueue
+    bool lockGranted;   // lockCallback pending in timer thread
+    bool readPending;   // timed input pending in timer thread
+    bool readLate;      // the device was slower than the timeout
+    bool inputStarted;  // some input passed in this read
+    unsigned long replyTimeout_ms;
+    unsigned long readTimeout_ms;
+    epicsTimerQueueActive* timerQueue;
+    epicsTimer* timer;
+
+    ReplayInterface(Client* client, ReplayTrace* trace, bool timed);
+    ~ReplayInterface();
+
+    // StreamBusInterface methods
+    bool lockRequest(unsigned long lockTimeout_ms);
+    bool unlock();
+    void finish();
+    bool writeRequest(const void* output, size_t size,
+        unsigned long writeTimeout_ms);
+    bool readRequest(unsigned long replyTimeout_ms,
+        unsigned long readTimeout_ms, ssize_t expectedLength, bool async);
+    void printStatus(StreamBuffer& buffer);
+
+    // epicsTimerNotify methods
+    epicsTimerNotify::expireStatus expire(const epicsTime &);
+
+    const ReplayTrace::Entry* nextInput(unsigned long timeout_ms,
+        double& wait);
+    void readInput();
+    void startOfTrace();
+    void passLock();
+    bool dequeueLock();
+
+public:
+    // static creator method
+    static StreamBusInterface* getBusInterface(Client* client,
+        const char* busname, int addr, const char* param);
+};
+
+RegisterStreamBusInterface(ReplayInterface);
+
+ReplayInterface::
+ReplayInterface(Client* client, ReplayTrace* trace, bool timed) :
+    StreamBusInterface(client), trace(trace), timed(timed),
+    nextLock(NULL), lockWaiting(false), lockGranted(false),
+    readPending(false), readLate(false), inputStarted(false),
+    replyTimeout_ms(0), readTimeout_ms(0)
+{
+    timerQueue = &epicsTimerQueueActive::allocate(true);
+    timer = &timerQueue->createTimer();
+}
+
+ReplayInterface::
+~ReplayInterface()
+{
+    dequeueLock();
+    lockGranted = false;
+    passLock();
+    timer->destroy();
+    timerQueue->release();
+}
+
+StreamBusInterface* ReplayInterface::
+getBusInterface(Client* client,
+    const char* busname, int, const char*)
+{
+    ReplayTrace* trace;
+    bool timed;
+
+    if (strncmp(busname, "replay:", 7) == 0)
+    {
+        timed = false;
+        busname += 7;
+    }
+    else if (strncmp(busname, "replaytimed:", 12) == 0)
+    {
+        timed = true;
+        busname += 12;
+    }
+    else return NULL;
+    trace = ReplayTrace::get(busname);
+    if (!trace) return NULL;
+    debug("ReplayInterface::getBusInterface(%s): %s replay of %s\n",
+        client->name(), timed ? "timed" : "fast", busname);
+    return new ReplayInterface(client, trace, timed);
+}
+
+// The lock is not a mutex because unlock() may come from any thread,
+// e.g. from the timer thread after a "wait" command in the protocol.
+bool ReplayInterface::
+lockRequest(unsigned long lockTimeout_ms)
+{
+    ReplayInterface** pc;
+
+    debug("ReplayInterface::lockRequest(%s, %ld msec)\n",
+        clientName(), lockTimeout_ms);
+    epicsMutexMustLock(trace->lockMutex);
+    if (trace->lockOwner)
+    {
+        for (pc = &trace->lockQueue; *pc; pc = &(*pc)->nextLock);
+        *pc = this;
+        nextLock = NULL;
+        lockWaiting = true;
+        // before passLock() can start the timer to grant the lock
+        if (lockTimeout_ms) timer->start(*this, lockTimeout_ms*0.001);
+        epicsMutexUnlock(trace->lockMutex);
+        debug("ReplayInterface::lockRequest(%s): waiting for %s\n",
+            clientName(), trace->filename);
+        return true;
+        // continues with:
+        //    passLock() -> expire() -> lockCallback()
+        // or expire() -> lockCallback(StreamIoTimeout)
+    }
+    trace->lockOwner = this;
+    epicsMutexUnlock(trace->lockMutex);
+    startOfTrace();
+    lockCallback(StreamIoSuccess);
+    return true;
+}
+
+bool ReplayInterface::
+unlock()
+{
+    debug("ReplayInterface::unlock(%s)\n", clientName());
+    passLock();
+    return true;
+}
+
+void ReplayInterface::
+finish()
+{
+    // protocol aborted while waiting for the lock or for input
+    bool granted;
+
+    epicsMutexMustLock(trace->mutex);
+    readPending = false;
+    epicsMutexUnlock(trace->mutex);
+    dequeueLock();
+    epicsMutexMustLock(trace->lockMutex);
+    granted = lockGranted;
+    lockGranted = false;
+    epicsMutexUnlock(trace->lockMutex);
+    if (granted) passLock();
+}
+
+void ReplayInterface::
+startOfTrace()
+{
+    epicsMutexMustLock(trace->mutex);
+    if (trace->position >= trace->count || trace->loops == 0)
+    {
+        debug("ReplayInterface::startOfTrace(%s): start of trace %s\n",
+            clientName(), trace->filename);
+        trace->rewind();
+    }
+    epicsMutexUnlock(trace->mutex);
+}
+
+// Give up the lock and pass it to the next waiting client.
+// The next client gets its lockCallback() in its own timer thread.
+void ReplayInterface::
+passLock()
+{
+    ReplayInterface* next = NULL;
+
+    epicsMutexMustLock(trace->lockMutex);
+    if (trace->lockOwner != this)
+    {
+        epicsMutexUnlock(trace->lockMutex);
+        return;
+    }
+    next = trace->lockQueue;
+    if (next)
+    {
+        trace->lockQueue = next->nextLock;
+        next->nextLock = NULL;
+        next->lockWaiting = false;
+        next->lockGranted = true;
+    }
+    trace->lockOwner = next;
+    epicsMutexUnlock(trace->lockMutex);
+    if (next)
+    {
+        debug("ReplayInterface::passLock(%s): next is %s\n",
+            clientName(), next->clientName());
+        next->timer->start(*next, 0.0);
+    }
+}
+
+// Remove from lock queue. Returns false if not waiting.
+bool ReplayInterface::
+dequeueLock()
+{
+    ReplayInterface** pc;
+    bool waiting;
+
+    epicsMutexMustLock(trace->lockMutex);
+    waiting = lockWaiting;
+    if (waiting)
+    {
+        for (pc = &trace->lockQueue; *pc; pc = &(*pc)->nextLock)
+        {
+            if (*pc == this)
+            {
+                *pc = nextLock;
+                break;
+            }
+        }
+        nextLock = NULL;
+        lockWaiting = false;
+    }
+    epicsMutexUnlock(trace->lockMutex);
+    return waiting;
+}
+
+epicsTimerNotify::expireStatus ReplayInterface::
+expire(const epicsTime &)
+{
+    bool granted;
+
+    epicsMutexMustLock(trace->lockMutex);
+    granted = lockGranted;
+    lockGranted = false;
+    epicsMutexUnlock(trace->lockMutex);
+    if (granted)
+    {
+        startOfTrace();
+        lockCallback(StreamIoSuccess);
+    }
+    else if (readPending)
+    {
+        readInput();
+    }
+    else if (dequeueLock())
+    {
+        debug("ReplayInterface::expire(%s): lock timeout\n", clientName());
+        lockCallback(StreamIoTimeout);
+    }
+    return noRestart;
+}
+
+bool ReplayInterface::
+writeRequest(const void* output, size_t size, unsigned long)
+{
+    const ReplayTrace::Entry* entry;
+
+    debug("ReplayInterface::writeRequest(%s, \"%s\")\n",
+        clientName(), StreamBuffer(output, size).expand()());
+    epicsMutexMustLock(trace->mutex);
+    // a real bus would flush old input now
+    if (flushInput())
+    {
+        while (trace->position < trace->count &&
+            trace->entries[trace->position].direction == '<')
+        {
+            entry = &trace->entries[trace->position++];
+            debug("ReplayInterface::writeRequest(%s): "
+                "flushing line %" Z "u\n", clientName(), entry->line);
+        }
+    }
+    if (trace->position >= trace->count)
+    {
+        error("%s: Output \"%s\" not expected at end of %s\n",
+            clientName(), StreamBuffer(output, size).expand()(),
+            trace->filename);
+        trace->mismatches++;
+    }
+    else if (trace->entries[trace->position].direction != '>')
+    {
+        error("%s: Output \"%s\" not expected at %s line %" Z "u\n",
+            clientName(), StreamBuffer(output, size).expand()(),
+            trace->filename, trace->entries[trace->position].line);
+        trace->mismatches++;
+    }
+    else
+    {
+        entry = &trace->entries[trace->position++];
+        trace->replayed++;
+        if (entry->size != size ||
+            memcmp(trace->bytes(entry), output, size) != 0)
+        {
+            error("%s: Output \"%s\" does not match %s line %" Z "u \"%s\"\n",
+                clientName(), StreamBuffer(output, size).expand()(),
+                trace->filename, entry->line,
+                StreamBuffer(trace->bytes(entry), entry->size).expand()());
+            trace->mismatches++;
+        }
+    }
+    epicsMutexUnlock(trace->mutex);
+    writeCallback(StreamIoSuccess);
+    return true;
+}
+
+// Get the next input line. In timed mode return NULL and the time to
+// wait if it is not due yet.
+const ReplayTrace::Entry* ReplayInterface::
+nextInput(unsigned long timeout_ms, double& wait)
+{
+    const ReplayTrace::Entry* entry;
+
+    wait = 0.0;
+    if (trace->position >= trace->count) return NULL;
+    entry = &trace->entries[trace->position];
+    if (entry->direction != '<') return NULL;
+    if (timed && entry->time >= 0 && trace->firstTime >= 0)
+    {
+        epicsTimeStamp now;
+        epicsTimeGetCurrent(&now);
+        wait = entry->time - trace->firstTime -
+            epicsTimeDiffInSeconds(&now, &trace->startTime);
+        if (wait > timeout_ms * 0.001)
+        {
+            // the device was slower than the timeout
+            wait = timeout_ms * 0.001;
+            readLate = true;
+            return NULL;
+        }
+        if (wait > 0) return NULL;
+        wait = 0.0;
+    }
+    trace->position++;
+    trace->replayed++;
+    return entry;
+}
+
+bool ReplayInterface::
+readRequest(unsigned long replyTimeout_ms, unsigned long readTimeout_ms,
+    ssize_t, bool async)
+{
+    debug("ReplayInterface::readRequest(%s, %ld msec reply, %ld msec read)\n",
+        clientName(), replyTimeout_ms, readTimeout_ms);
+    if (async) return false;
+    this->replyTimeout_ms = replyTimeout_ms;
+    this->readTimeout_ms = readTimeout_ms;
+    epicsMutexMustLock(trace->mutex);
+    inputStarted = false;
+    readLate = false;
+    readPending = true;
+    epicsMutexUnlock(trace->mutex);
+    readInput();
+    return true;
+}
+
+// Pass input lines to the client until it has enough.
+// Called by readRequest() and by expire() when timed input is due.
+void ReplayInterface::
+readInput()
+{
+    const ReplayTrace::Entry* entry;
+    double wait;
+    ssize_t more;
+
+    // input may be read without lock, the mutex is recursive
+    // and only protects the trace position, not the bus lock
+    epicsMutexMustLock(trace->mutex);
+    if (!readPending)
+    {
+        // finish() has cancelled the read
+        epicsMutexUnlock(trace->mutex);
+        return;
+    }
+    readPending = false;
+    // like a stream device: the terminator or a timeout ends the input
+    while (1)
+    {
+        if (readLate)
+        {
+            readLate = false;
+            entry = NULL;
+        }
+        else
+        {
+            entry = nextInput(inputStarted ? readTimeout_ms : replyTimeout_ms,
+                wait);
+            if (!entry && wait > 0)
+            {
+                // never sleep here: continue in the timer thread
+                readPending = true;
+                timer->start(*this, wait);
+                break;
+            }
+        }
+        if (!entry)
+        {
+            readCallback(inputStarted ? StreamIoTimeout : StreamIoNoReply);
+            break;
+        }
+        inputStarted = true;
+        more = readCallback(entry->end ? StreamIoEnd : StreamIoSuccess,
+            trace->bytes(entry), entry->size);
+        if (!more) break;
+    }
+    epicsMutexUnlock(trace->mutex);
+}
+
+void ReplayInterface::
+printStatus(StreamBuffer& buffer)
+{
+    buffer.print("%s: %lu lines replayed, %lu mismatches",
+        trace->filename, trace->replayed, trace->mismatches);
+}
+
+// A trace file being written, shared by all clients which capture to it
+
+class CaptureFile
+{
+public:
+    static CaptureFile* first;
+    CaptureFile* next;
+    char* filename;
+    FILE* file;
+    epicsMutexId mutex;
+    epicsTimeStamp startTime;
+    StreamBuffer line;
+
+    CaptureFile(const char* filename, FILE* file);
+    static CaptureFile* get(const char* filename);
+    void write(const char* direction, const void* bytes, size_t size);
+};
+
+CaptureFile* CaptureFile::first;
+
+CaptureFile::
+CaptureFile(const char* filename, FILE* file) :
+    next(NULL), file(file)
+{
+    this->filename = new char[strlen(filename) + 1];
+    strcpy(this->filename, filename);
+    mutex = epicsMutexMustCreate();
+    epicsTimeGetCurrent(&startTime);
+}
+
+CaptureFile* CaptureFile::
+get(const char* filename)
+{
+    CaptureFile* capture;
+    FILE* file;
+
+    // called during iocInit, before any I/O
+    for (capture = first; capture; capture = capture->next)
+        if (strcmp(capture->filename, filename) == 0) return capture;
+    file = fopen(filename, "w");
+    if (!file)
+    {
+        error("Can't open capture file '%s'\n", filename);
+        return NULL;
+    }
+    fprintf(file, "# StreamDevice trace\n");
+    fflush(file);
+    capture = new CaptureFile(filename, file);
+    capture->next = first;
+    first = capture;
+    return capture;
+}
+
+void CaptureFile::
+write(const char* direction, const void* bytes, size_t size)
+{
+    epicsTimeStamp now;
+
+    epicsMutexMustLock(mutex);
+    epicsTimeGetCurrent(&now);
+    line.clear().print("%.6f %s ",
+        epicsTimeDiffInSeconds(&now, &startTime), direction);
+    escapeBytes(line, static_cast<const char*>(bytes), size);
+    line.append('\n');
+    fwrite(line(), 1, line.length(), file);
+    fflush(file);
+    epicsMutexUnlock(mutex);
+}
+
+// CaptureInterface: client of the real bus and bus of the real client.
+// Passes everything through and writes the traffic to the trace file.
+
+class CaptureInterface : StreamBusInterface, StreamBusInterface::Client
+{
+    CaptureFile* capture;
+    const char* output;
+    size_t outputSize;
+
+    CaptureInterface(StreamBusInterface::Client* client,
+        CaptureFile* capture);
+
+    // StreamBusInterface methods, passed to the real bus
+    bool lockRequest(unsigned long lockTimeout_ms)
+        { return busLockRequest(lockTimeout_ms); }
+    bool unlock()
+        { return busUnlock(); }
+    bool writeRequest(const void* output, size_t size,
+        unsigned long writeTimeout_ms);
+    bool readRequest(unsigned long replyTimeout_ms,
+        unsigned long readTimeout_ms, ssize_t expectedLength, bool async)
+        { return busReadRequest(replyTimeout_ms, readTimeout_ms,
+            expectedLength, async); }
+    bool supportsEvent()
+        { return busSupportsEvent(); }
+    bool supportsAsyncRead()
+        { return busSupportsAsyncRead(); }
+    bool acceptEvent(unsigned long mask, unsigned long replytimeout_ms)
+        { return busAcceptEvent(mask, replytimeout_ms); }
+    bool connectRequest(unsigned long connecttimeout_ms)
+        { return busConnectRequest(connecttimeout_ms); }
+    bool disconnectRequest()
+        { return busDisconnect(); }
+    void finish()
+        { busFinish(); }
+    void release();
+    void printStatus(StreamBuffer& buffer);
+
+    // Client methods, passed to the real client
+    void lockCallback(StreamIoStatus status)
+        { StreamBusInterface::lockCallback(status); }
+    void writeCallback(StreamIoStatus status);
+    ssize_t readCallback(StreamIoStatus status,
+        const void* input, size_t size);
+    void eventCallback(StreamIoStatus status)
+        { StreamBusInterface::eventCallback(status); }
+    void connectCallback(StreamIoStatus status)
+        { StreamBusInterface::connectCallback(status); }
+    void disconnectCallback(StreamIoStatus status)
+        { StreamBusInterface::disconnectCallback(status); }
+    long priority()
+        { return StreamBusInterface::priority(); }
+    const char* getInTerminator(size_t& length)
+        { return StreamBusInterface::getInTerminator(length); }
+    const char* getOutTerminator(size_t& length)
+        { return StreamBusInterface::getOutTerminator(length); }
+    bool flushInput()
+        { return StreamBusInterface::flushInput(); }
+    const char* name()
+        { return clientName(); }
+
+public:
+    // static creator method
+    static StreamBusInterface* getBusInterface(
+        StreamBusInterface::Client* client,
+        const char* busname, int addr, const char* param);
+};
+
+RegisterStreamBusInterface(CaptureInterface);
+
+CaptureInterface::
+CaptureInterface(StreamBusInterface::Client* client, CaptureFile* capture) :
+    StreamBusInterface(client), capture(capture),
+    output(NULL), outputSize(0)
+{
+    businterface = NULL;
+}
+
+StreamBusInterface* CaptureInterface::
+getBusInterface(StreamBusInterface::Client* client,
+    const char* busname, int addr, const char* param)
+{
+    const char* bus;
+    CaptureFile* capture;
+    CaptureInterface* interface;
+
+    if (strncmp(busname, "capture:", 8) != 0) return NULL;
+    busname += 8;
+    // the file name may contain : (drive letter), the bus name not
+    bus = strrchr(busname, ':');
+    if (!bus || bus == busname || !bus[1])
+    {
+        error("%s: Bus capture:%s is not capture:file:bus\n",
+            client->name(), busname);
+        return NULL;
+    }
+    StreamBuffer filename(busname, bus - busname);
+    bus++;
+    capture = CaptureFile::get(filename());
+    if (!capture) return NULL;
+    interface = new CaptureInterface(client, capture);
+    interface->businterface = StreamBusInterface::find(interface,
+        bus, addr, param);
+    if (!interface->businterface)
+    {
+        error("%s: Cannot find a bus named '%s' to capture\n",
+            client->name(), bus);
+        delete interface;
+        return NULL;
+    }
+    debug("CaptureInterface::getBusInterface(%s): capture %s to %s\n",
+        client->name(), bus, filename());
+    return interface;
+}
+
+void CaptureInterface::
+release()
+{
+    busRelease();
+    businterface = NULL;
+    delete this;
+}
+
+bool CaptureInterface::
+writeRequest(const void* output, size_t size, unsigned long writeTimeout_ms)
+{
+    // output stays valid until writeCallback()
+    this->output = static_cast<const char*>(output);
+    outputSize = size;
+    return busWriteRequest(output, size, writeTimeout_ms);
+}
+
+void CaptureInterface::
+writeCallback(StreamIoStatus status)
+{
+    if (status == StreamIoSuccess)
+        capture->write(">", output, outputSize);
+    StreamBusInterface::writeCallback(status);
+}
+
+ssize_t CaptureInterface::
+readCallback(StreamIoStatus status, const void* input, size_t size)
+{
+    if (status == StreamIoEnd)
+        capture->write("<|", input, size);
+    else if (input && size)
+        capture->write("<", input, size);
+    return StreamBusInterface::readCallback(status, input, size);
+}
+
+void CaptureInterface::
+printStatus(StreamBuffer& buffer)
+{
+    size_t length = buffer.length();
+    busPrintStatus(buffer);
+    buffer.print("%s(capture to %s)",
+        buffer.length() > length ? " " : "", capture->filename);
+}
@@ -0,0 +1,773 @@
+/*************************************************************************
+* This is a bus interface for StreamDevice which simulates devices
+* in the IOC process. Requests are answered from a table of rules.
+* Please see ../docs/ for detailed documentation.
+*
+* This file is part of StreamDevice.
+*
+* StreamDevice is free software: You can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* StreamDevice is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with StreamDevice. If not, see https://www.gnu.org/licenses/.
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include "pcre2.h"
+
+#include "epicsMutex.h"
+#include "epicsEvent.h"
+#include "epicsThread.h"
+#include "epicsTime.h"
+#include "iocsh.h"
+
+#include "StreamBusInterface.h"
+#include "StreamError.h"
+#include "StreamBuffer.h"
+
+#define Z PRINTF_SIZE_T_PREFIX
+
+// Configure a simulated device with
+//   streamSimulatorConfigure name rulefile [threads]
+// and use name as the bus name in the records.
+//
+// Rule file format, one rule per line:
+//   "request" "reply" [latency_ms [jitter_ms]]
+// The request is a PCRE2 regular expression which must match the
+// whole output of the record, including the terminator.
+// The reply may use the escape sequences \r \n \t \\ \" \xHH and \0.
+// $0 to $9 insert the whole request or a sub-expression, $$ is a $.
+// An empty reply "" means: the device does not reply.
+// The reply is sent after latency_ms plus a random value between
+// -jitter_ms and +jitter_ms. Lines starting with # are comments.
+// The first matching rule is used.
+//
+// Every client talks to its own instance of the simulated device.
+// Thus clients do not wait for each other like on a real bus.
+// Lock and write are done immediately. Replies and reply timeouts
+// are delivered by the worker threads of the simulator in the order
+// of their due time, like from the I/O threads of a real bus.
+
+static const int maxGroups = 10;
+
+struct SimulatorRule
+{
+    SimulatorRule* next;
+    pcre2_code* code;
+    StreamBuffer reply;
+    double latency;     // seconds
+    double jitter;      // seconds
+    size_t line;
+};
+
+class SimulatorInterface;
+
+class Simulator
+{
+public:
+    struct Job
+    {
+        double due;
+        SimulatorInterface* client;
+        unsigned long generation;
+    };
+
+    static Simulator* first;
+    Simulator* next;
+    char* name;
+    SimulatorRule* rules;
+    epicsMutexId mutex;
+    epicsEventId wakeup;
+    epicsTimeStamp startTime;
+    Job* jobs;          // heap, earliest due time first
+    size_t jobCount;
+    size_t jobSize;
+    unsigned long long randomState;
+    unsigned long requests;
+    unsigned long replies;
+    unsigned long unmatched;
+    unsigned long late;
+
+    Simulator(const char* name);
+    ~Simulator();
+    bool readRules(const char* filename);
+    static Simulator* find(const char* name);
+    double now();
+    double delay(const SimulatorRule* rule);
+    const SimulatorRule* match(pcre2_match_data* matchData,
+        const char* request, size_t size, int& groups);
+    void schedule(SimulatorInterface* client, double due);
+    Job pop();
+    static void workerThread(void* simulator);
+    void work();
+};
+
+Simulator* Simulator::first;
+
+// SimulatorInterface: one per client
+
+class SimulatorInterface : StreamBusInterface
+{
+    friend class Simulator;
+
+    Simulator* simulator;
+    pcre2_match_data* matchData;
+    StreamBuffer reply;
+    bool replyPending;
+    double replyDue;
+    unsigned long generation;   // outdates scheduled jobs
+    unsigned int queued;        // scheduled jobs
+    bool busy;                  // worker is in a callback
+    bool waiting;               // release() waits for callback
+    bool released;
+    epicsThreadId worker;
+
+    SimulatorInterface(Client* client, Simulator* simulator);
+    ~SimulatorInterface();
+
+    // StreamBusInterface methods
+    bool lockRequest(unsigned long lockTimeout_ms);
+    bool unlock();
+    bool writeRequest(const void* output, size_t size,
+        unsigned long writeTimeout_ms);
+    bool readRequest(unsigned long replyTimeout_ms,
+        unsigned long readTimeout_ms, ssize_t expectedLength, bool async);
+    void finish();
+    void release();
+    void printStatus(StreamBuffer& buffer);
+
+    void deliver();
+
+public:
+    // static creator method
+    static StreamBusInterface* getBusInterface(Client* client,
+        const char* busname, int addr, const char* param);
+};
+
+RegisterStreamBusInterface(SimulatorInterface);
+
+Simulator::
+Simulator(const char* name) :
+    next(NULL), rules(NULL), jobs(NULL), jobCount(0), jobSize(0),
+    randomState(0x9e3779b97f4a7c15ULL), requests(0), replies(0),
+    unmatched(0), late(0)
+{
+    this->name = new char[strlen(name) + 1];
+    strcpy(this->name, name);
+    mutex = epicsMutexMustCreate();
+    wakeup = epicsEventMustCreate(epicsEventEmpty);
+    epicsTimeGetCurrent(&startTime);
+}
+
+Simulator::
+~Simulator()
+{
+    SimulatorRule* rule;
+
+    while ((rule = rules) != NULL)
+    {
+        rules = rule->next;
+        pcre2_code_free(rule->code);
+        delete rule;
+    }
+    delete[] jobs;
+    delete[] name;
+    epicsEventDestroy(wakeup);
+    epicsMutexDestroy(mutex);
+}
+
+// Parse a quoted string. For the request, escapes are left to PCRE2.
+static bool parseString(const char*& p, const char* eol,
+    StreamBuffer& string, bool unescape)
+{
+    size_t i;
+
+    while (p < eol && isspace((unsigned char)*p)) p++;
+    if (p == eol || *p != '"') return false;
+    for (p++; p < eol && *p != '"'; p++)
+    {
+        if (*p != '\\' || p + 1 == eol)
+        {
+            string.append(*p);
+            continue;
+        }
+        p++;
+        if (!unescape)
+        {
+            if (*p != '"') string.append('\\');
+            string.append(*p);
+            continue;
+        }
+        switch (*p)
+        {
+            case 'r': string.append('\r'); break;
+            case 'n': string.append('\n'); break;
+            case 't': string.append('\t'); break;
+            case '0': string.append('\0'); break;
+            case 'x':
+            {
+                char hex[3] = {0};
+                for (i = 0; i < 2 && p + 1 < eol &&
+                    isxdigit((unsigned char)p[1]); i++) hex[i] = *++p;
+                string.append((char)strtoul(hex, NULL, 16));
+                break;
+            }
+            default: string.append(*p);
+        }
+    }
+    if (p == eol) return false;
+    p++;
+    return true;
+}
+
+bool Simulator::
+readRules(const char* filename)
+{
+    FILE* file;
+    StreamBuffer text;
+    char buffer[4096];
+    size_t n, lineno;
+    const char* p;
+    const char* end;
+    char* q;
+    SimulatorRule** last = &rules;
+    StreamBuffer request;
+    int errorcode;
+    PCRE2_SIZE erroroffset;
+    PCRE2_UCHAR message[120];
+    uint32_t captures;
+
+    file = fopen(filename, "rb");
+    if (!file)
+    {
+        error("streamSimulatorConfigure %s: Can't open rule file '%s'\n",
+            name, filename);
+        return false;
+    }
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, n);
+    fclose(file);
+
+    p = text();
+    end = p + text.length();
+    for (lineno = 1; p < end; lineno++)
+    {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        while (p < eol && isspace((unsigned char)*p)) p++;
+        if (p == eol || *p == '#')
+        {
+            p = eol + 1;
+            continue;
+        }
+        SimulatorRule* rule = new SimulatorRule;
+        rule->next = NULL;
+        rule->code = NULL;
+        rule->latency = 0.0;
+        rule->jitter = 0.0;
+        rule->line = lineno;
+        request.clear();
+        if (!parseString(p, eol, request, false) ||
+            !parseString(p, eol, rule->reply, true))
+        {
+            error("%s line %" Z "u: Expect \"request\" \"reply\"\n",
+                filename, lineno);
+            delete rule;
+            return false;
+        }
+        rule->latency = strtod(p, &q) * 0.001;
+        p = q;
+        rule->jitter = strtod(p, &q) * 0.001;
+        p = q;
+        while (p < eol && isspace((unsigned char)*p)) p++;
+        if (p < eol || rule->latency < 0 || rule->jitter < 0)
+        {
+            error("%s line %" Z "u: Expect latency_ms and jitter_ms"
+                " after reply\n", filename, lineno);
+            delete rule;
+            return false;
+        }
+        // the request must match the whole output
+        rule->code = pcre2_compile((PCRE2_SPTR)request(), request.length(),
+            PCRE2_ANCHORED | PCRE2_ENDANCHORED, &errorcode, &erroroffset,
+            NULL);
+        if (!rule->code)
+        {
+            pcre2_get_error_message(errorcode, message, sizeof(message));
+            error("%s line %" Z "u: %s in request pattern\n",
+                filename, lineno, message);
+            delete rule;
+            return false;
+        }
+        // $n in the reply must refer to a sub-expression of the request
+        pcre2_pattern_info(rule->code, PCRE2_INFO_CAPTURECOUNT, &captures);
+        for (q = rule->reply(); q < rule->reply(rule->reply.length()); q++)
+        {
+            if (*q != '$' || q + 1 == rule->reply(rule->reply.length()))
+                continue;
+            q++;
+            if (isdigit((unsigned char)*q) && (uint32_t)(*q - '0') > captures)
+            {
+                error("%s line %" Z "u: $%c in reply but request has only "
+                    "%u sub-expressions\n", filename, lineno, *q, captures);
+                delete rule;
+                return false;
+            }
+        }
+        pcre2_jit_compile(rule->code, PCRE2_JIT_COMPLETE);
+        *last = rule;
+        last = &rule->next;
+        p = eol + 1;
+    }
+    debug("Simulator::readRules(%s): %" Z "u lines\n", filename, lineno);
+    return true;
+}
+
+Simulator* Simulator::
+find(const char* name)
+{
+    Simulator* simulator;
+
+    for (simulator = first; simulator; simulator = simulator->next)
+        if (strcmp(simulator->name, name) == 0) break;
+    return simulator;
+}
+
+double Simulator::
+now()
+{
+    epicsTimeStamp time;
+
+    epicsTimeGetCurrent(&time);
+    return epicsTimeDiffInSeconds(&time, &startTime);
+}
+
+// Latency with uniformly distributed jitter. Call with mutex locked.
+double Simulator::
+delay(const SimulatorRule* rule)
+{
+    double delay = rule->latency;
+
+    if (rule->jitter > 0)
+    {
+        // xorshift64*
+        randomState ^= randomState >> 12;
+        randomState ^= randomState << 25;
+        randomState ^= randomState >> 27;
+        double r = (double)((randomState * 0x2545f4914f6cdd1dULL) >> 11)
+            / (double)(1ULL << 53);
+        delay += (2 * r - 1) * rule->jitter;
+        if (delay < 0) delay = 0;
+    }
+    return delay;
+}
+
+// The rules are constant after configuration.
+// Thus clients can match in parallel with their own match data.
+const SimulatorRule* Simulator::
+match(pcre2_match_data* matchData, const char* request, size_t size,
+    int& groups)
+{
+    const SimulatorRule* rule;
+
+    // groups: number of valid pairs in the ovector
+    for (rule = rules; rule; rule = rule->next)
+    {
+        groups = pcre2_match(rule->code, (PCRE2_SPTR)request, size, 0, 0,
+            matchData, NULL);
+        if (groups == 0) groups = maxGroups;
+        if (groups > 0) break;
+    }
+    return rule;
+}
+
+// Call with mutex locked.
+void Simulator::
+schedule(SimulatorInterface* client, double due)
+{
+    size_t i, parent;
+
+    if (jobCount == jobSize)
+    {
+        jobSize = jobSize ? 2 * jobSize : 64;
+        Job* j = new Job[jobSize];
+        if (jobCount) memcpy(j, jobs, jobCount * sizeof(Job));
+        delete[] jobs;
+        jobs = j;
+    }
+    // sift up
+    for (i = jobCount++; i > 0; i = parent)
+    {
+        parent = (i - 1) / 2;
+        if (jobs[parent].due <= due) break;
+        jobs[i] = jobs[parent];
+    }
+    jobs[i].due = due;
+    jobs[i].client = client;
+    jobs[i].generation = client->generation;
+    client->queued++;
+    // wake a worker if this is the new earliest job
+    if (i == 0) epicsEventSignal(wakeup);
+}
+
+// Call with mutex locked and jobCount > 0.
+Simulator::Job Simulator::
+pop()
+{
+    Job job = jobs[0];
+    Job last = jobs[--jobCount];
+    size_t i, child;
+
+    // sift down
+    for (i = 0; (child = 2 * i + 1) < jobCount; i = child)
+    {
+        if (child + 1 < jobCount && jobs[child + 1].due < jobs[child].due)
+            child++;
+        if (last.due <= jobs[child].due) break;
+        jobs[i] = jobs[child];
+    }
+    jobs[i] = last;
+    return job;
+}
+
+void Simulator::
+workerThread(void* simulator)
+{
+    static_cast<Simulator*>(simulator)->work();
+}
+
+void Simulator::
+work()
+{
+    double wait;
+
+    epicsMutexMustLock(mutex);
+    while (1)
+    {
+        if (jobCount == 0)
+        {
+            epicsMutexUnlock(mutex);
+            epicsEventMustWait(wakeup);
+            epicsMutexMustLock(mutex);
+            continue;
+        }
+        wait = jobs[0].due - now();
+        if (wait > 0)
+        {
+            epicsMutexUnlock(mutex);
+            epicsEventWaitWithTimeout(wakeup, wait);
+            epicsMutexMustLock(mutex);
+            continue;
+        }
+        Job job = pop();
+        // let other workers handle the next job meanwhile
+        if (jobCount) epicsEventSignal(wakeup);
+        SimulatorInterface* client = job.client;
+        client->queued--;
+        if (!client->released && job.generation == client->generation)
+        {
+            client->busy = true;
+            client->worker = epicsThreadGetIdSelf();
+            epicsMutexUnlock(mutex);
+            client->deliver();
+            epicsMutexMustLock(mutex);
+            client->busy = false;
+        }
+        if (client->released && !client->queued && !client->busy &&
+            !client->waiting)
+            delete client;
+    }
+}
+
+SimulatorInterface::
+SimulatorInterface(Client* client, Simulator* simulator) :
+    StreamBusInterface(client), simulator(simulator),
+    replyPending(false), replyDue(0), generation(0), queued(0),
+    busy(false), waiting(false), released(false), worker(0)
+{
+    matchData = pcre2_match_data_create(maxGroups, NULL);
+}
+
+SimulatorInterface::
+~SimulatorInterface()
+{
+    pcre2_match_data_free(matchData);
+}
+
+StreamBusInterface* SimulatorInterface::
+getBusInterface(Client* client,
+    const char* busname, int addr, const char*)
+{
+    Simulator* simulator = Simulator::find(busname);
+
+    if (!simulator) return NULL;
+    if (addr >= 0)
+    {
+        error("%s: Bus %s has no addresses\n",
+            client->name(), busname);
+        return NULL;
+    }
+    debug("SimulatorInterface::getBusInterface(%s): new interface allocated\n",
+        busname);
+    return new SimulatorInterface(client, simulator);
+}
+
+bool SimulatorInterface::
+lockRequest(unsigned long)
+{
+    debug("SimulatorInterface::lockRequest(%s)\n", clientName());
+    lockCallback(StreamIoSuccess);
+    return true;
+}
+
+bool SimulatorInterface::
+unlock()
+{
+    return true;
+}
+
+bool SimulatorInterface::
+writeRequest(const void* output, size_t size, unsigned long)
+{
+    const char* request = static_cast<const char*>(output);
+    const SimulatorRule* rule;
+    const char* p;
+    const char* end;
+    PCRE2_SIZE* ovector;
+    int groups;
+    int n;
+
+    debug("SimulatorInterface::writeRequest(%s, \"%s\")\n",
+        clientName(), StreamBuffer(request, size).expand()());
+    rule = simulator->match(matchData, request, size, groups);
+    epicsMutexMustLock(simulator->mutex);
+    simulator->requests++;
+    // a new request discards an old reply which has not been read
+    replyPending = false;
+    if (!rule)
+    {
+        simulator->unmatched++;
+        epicsMutexUnlock(simulator->mutex);
+        error("%s: No rule of simulator %s matches \"%s\"\n",
+            clientName(), simulator->name,
+            StreamBuffer(request, size).expand()());
+        writeCallback(StreamIoSuccess);
+        return true;
+    }
+    replyDue = simulator->now() + simulator->delay(rule);
+    epicsMutexUnlock(simulator->mutex);
+
+    reply.clear();
+    ovector = pcre2_get_ovector_pointer(matchData);
+    p = rule->reply();
+    end = p + rule->reply.length();
+    for (; p < end; p++)
+    {
+        if (*p == '$' && p + 1 < end && p[1] == '$')
+        {
+            reply.append(*++p);
+            continue;
+        }
+        if (*p != '$' || p + 1 == end || !isdigit((unsigned char)p[1]))
+        {
+            reply.append(*p);
+            continue;
+        }
+        n = *++p - '0';
+        // groups not set in this match are empty
+        if (n < groups && ovector[2*n] != PCRE2_UNSET)
+            reply.append(request + ovector[2*n],
+                ovector[2*n+1] - ovector[2*n]);
+    }
+    debug("SimulatorInterface::writeRequest(%s): line %" Z "u matches, reply \"%s\"\n",
+        clientName(), rule->line, reply.expand()());
+    replyPending = reply.length() != 0;
+    writeCallback(StreamIoSuccess);
+    return true;
+}
+
+bool SimulatorInterface::
+readRequest(unsigned long replyTimeout_ms, unsigned long,
+    ssize_t, bool async)
+{
+    double now, due;
+
+    debug("SimulatorInterface::readRequest(%s, %ld msec reply)\n",
+        clientName(), replyTimeout_ms);
+    if (async) return false;
+    epicsMutexMustLock(simulator->mutex);
+    now = simulator->now();
+    due = now + replyTimeout_ms * 0.001;
+    if (replyPending)
+    {
+        if (replyDue <= due)
+            due = replyDue;
+        else
+        {
+            // too late: the client will have given up
+            replyPending = false;
+            simulator->late++;
+        }
+    }
+    simulator->schedule(this, due);
+    epicsMutexUnlock(simulator->mutex);
+    return true;
+    // continues with readCallback() from a worker thread
+}
+
+// Called by a worker thread without the mutex.
+void SimulatorInterface::
+deliver()
+{
+    if (!replyPending)
+    {
+        readCallback(StreamIoNoReply);
+        return;
+    }
+    // the client may start the next request from readCallback()
+    StreamBuffer input(reply);
+    replyPending = false;
+    epicsMutexMustLock(simulator->mutex);
+    simulator->replies++;
+    epicsMutexUnlock(simulator->mutex);
+    // one reply is one message like a datagram
+    readCallback(StreamIoEnd, input(), input.length());
+}
+
+void SimulatorInterface::
+finish()
+{
+    debug("SimulatorInterface::finish(%s)\n", clientName());
+    epicsMutexMustLock(simulator->mutex);
+    generation++;
+    replyPending = false;
+    epicsMutexUnlock(simulator->mutex);
+}
+
+void SimulatorInterface::
+release()
+{
+    debug("SimulatorInterface::release(%s)\n", clientName());
+    epicsMutexMustLock(simulator->mutex);
+    released = true;
+    generation++;
+    if (busy && worker == epicsThreadGetIdSelf())
+    {
+        // released from its own callback: the worker deletes it
+        epicsMutexUnlock(simulator->mutex);
+        return;
+    }
+    waiting = true;
+    while (busy)
+    {
+        epicsMutexUnlock(simulator->mutex);
+        epicsThreadSleep(0.001);
+        epicsMutexMustLock(simulator->mutex);
+    }
+    waiting = false;
+    if (queued)
+    {
+        // the worker deletes it when it finds the outdated job
+        epicsMutexUnlock(simulator->mutex);
+        return;
+    }
+    epicsMutexUnlock(simulator->mutex);
+    delete this;
+}
+
+void SimulatorInterface::
+printStatus(StreamBuffer& buffer)
+{
+    epicsMutexMustLock(simulator->mutex);
+    buffer.print("%lu requests, %lu replies, %lu unmatched, %lu late",
+        simulator->requests, simulator->replies, simulator->unmatched,
+        simulator->late);
+    epicsMutexUnlock(simulator->mutex);
+}
+
+// iocsh command to configure a simulator
+
+static void streamSimulatorConfigure(const char* name, const char* rulefile,
+    int threads)
+{
+    Simulator* simulator;
+    char threadname[32];
+    int i;
+
+    if (!name || !*name || !rulefile || !*rulefile)
+    {
+        printf("usage: streamSimulatorConfigure name rulefile [threads]\n");
+        return;
+    }
+    if (Simulator::find(name))
+    {
+        error("streamSimulatorConfigure: %s already exists\n", name);
+        return;
+    }
+    if (threads <= 0) threads = 1;
+    simulator = new Simulator(name);
+    if (!simulator->readRules(rulefile))
+    {
+        delete simulator;
+        return;
+    }
+    for (i = 0; i < threads; i++)
+    {
+        sprintf(threadname, "%.20s%d", name, i);
+        if (!epicsThreadCreate(threadname, epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackMedium),
+            Simulator::workerThread, simulator))
+        {
+            error("streamSimulatorConfigure %s: Can't start thread\n", name);
+            if (i == 0)
+            {
+                delete simulator;
+                return;
+            }
+            break;
+        }
+    }
+    simulator->next = Simulator::first;
+    Simulator::first = simulator;
+}
+
+static const iocshArg streamSimulatorConfigureArg0 =
+    { "name", iocshArgString };
+static const iocshArg streamSimulatorConfigureArg1 =
+    { "rulefile", iocshArgString };
+static const iocshArg streamSimulatorConfigureArg2 =
+    { "[threads]", iocshArgInt };
+static const iocshArg * const streamSimulatorConfigureArgs[] =
+    { &streamSimulatorConfigureArg0, &streamSimulatorConfigureArg1,
+      &streamSimulatorConfigureArg2 };
+static const iocshFuncDef streamSimulatorConfigureDef =
+    { "streamSimulatorConfigure", 3, streamSimulatorConfigureArgs };
+
+static void streamSimulatorConfigureFunc(const iocshArgBuf *args)
+{
+    streamSimulatorConfigure(args[0].sval, args[1].sval, args[2].ival);
+}
+
+// Register the command when the library is loaded.
+// A registrar() in stream.dbd would not work on architectures
+// which share the dbd file but do not build this interface.
+static struct SimulatorInterfaceIocshRegistrar
+{
+    SimulatorInterfaceIocshRegistrar()
+    {
+        iocshRegister(&streamSimulatorConfigureDef,
+            streamSimulatorConfigureFunc);
+    }
+} simulatorInterfaceIocshRegistrar;
@@ -168,3 +168,21 @@ priority()
 {
     return 0;
 }
+
+bool StreamBusInterface::Client::
+flushInput()
+{
+    return true;
+}
+
+unsigned long StreamBusInterface::Client::
+getDeadline()
+{
+    return 0;
+}
+
+const char* StreamBusInterface::Client::
+getPollGroup()
+{
+    return NULL;
+}
@@ -50,6 +50,9 @@ public:
         virtual long priority();
         virtual const char* getInTerminator(size_t& length) = 0;
         virtual const char* getOutTerminator(size_t& length) = 0;
+        virtual bool flushInput();
+        virtual unsigned long getDeadline();
+        virtual const char* getPollGroup();
     public:
         virtual const char* name() = 0;
         virtual ~Client();
@@ -130,6 +133,9 @@ protected:
     const char* getOutTerminator(size_t& length)
         { return client->getOutTerminator(length); }
     long priority() { return client->priority(); }
+    bool flushInput() { return client->flushInput(); }
+    unsigned long getDeadline() { return client->getDeadline(); }
+    const char* getPollGroup() { return client->getPollGroup(); }
     const char* clientName() { return client->name(); }
 
 // default implementations
@@ -23,6 +23,13 @@
 #include <ctype.h>
 #include <stdlib.h>
 
+#include "epicsVersion.h"
+#ifdef BASE_VERSION
+#define EPICS_3_13
+#else
+#include "epicsMutex.h"
+#endif
+
 #include "StreamCore.h"
 #include "StreamError.h"
 
@@ -30,8 +37,23 @@
 
 int streamErrorDeadTime = 0;
 
+// skip formatstring <eos>, long enum formats make this worth a fast loop
+static const char* skipFormatString(const char* s)
+{
+    static const char stop[] = { esc, 0 };
+    while (*(s += strcspn(s, stop)))
+        s += 2; // escaped character, may be <eos>
+    return s + 1;
+}
+
 /// debug functions /////////////////////////////////////////////
 
+static const char* printFormat(StreamBuffer& buffer, const char* format)
+{
+    StreamProtocolParser::printString(buffer.clear(), format);
+    return buffer();
+}
+
 char* StreamCore::
 printCommands(StreamBuffer& buffer, const char* c)
 {
@@ -53,6 +75,16 @@ printCommands(StreamBuffer& buffer, const char* c)
                 c = StreamProtocolParser::printString(buffer, c);
                 buffer.append("\";\n");
                 break;
+            case out_literal:
+            {
+                size_t length = extract<size_t>(c);
+                size_t termlength = extract<size_t>(c);
+                buffer.append("    out \"");
+                buffer.append(StreamBuffer(c, length-termlength).expand());
+                buffer.append("\"; # literal\n");
+                c += length;
+                break;
+            }
             case wait:
                 timeout = extract<unsigned long>(c);
                 buffer.print("    wait %ld; # ms\n", timeout);
@@ -82,6 +114,182 @@ printCommands(StreamBuffer& buffer, const char* c)
     }
 }
 
+// Let the converters free resources of the formats in compiled code.
+void StreamCore::
+releaseCommands(StreamBuffer& code)
+{
+    if (!code) return;
+    const char* c = code();
+    while (1)
+    {
+        switch (*c++)
+        {
+            case end:
+                code.clear();
+                return;
+            case in:
+            case out:
+            case exec:
+                c = StreamProtocolParser::releaseFormats(c);
+                break;
+            case out_literal:
+            {
+                size_t length = extract<size_t>(c);
+                extract<size_t>(c);
+                c += length;
+                break;
+            }
+            case wait:
+            case connect:
+                extract<unsigned long>(c);
+                break;
+            case event:
+                extract<unsigned long>(c);
+                extract<unsigned long>(c);
+                break;
+            case disconnect:
+                break;
+            default:
+                error("StreamCore::releaseCommands(%s): INTERNAL ERROR: "
+                    "unknown command 0x%02x\n", name(), c[-1]);
+                code.clear();
+                return;
+        }
+    }
+}
+
+void StreamCore::
+releaseAllCommands()
+{
+    releaseCommands(commands);
+    releaseHandler(onInit);
+    releaseHandler(onWriteTimeout);
+    releaseHandler(onReplyTimeout);
+    releaseHandler(onReadTimeout);
+    releaseHandler(onMismatch);
+}
+
+/* Exception handlers are often the same boilerplate in many records.
+   The first record compiles a handler and offers it to other records
+   with the same protocol file, protocol name, arguments and handler.
+   The next record compiles it again. If the code is identical, it does
+   not depend on the record (no record fields, no per-format state like
+   regexp match data) and all further records use it without compiling.
+   Otherwise each record keeps its own code.
+   The protocol file generation avoids using code from before streamReload.
+*/
+#ifndef EPICS_3_13
+static epicsMutex sharedHandlersMutex;
+#endif
+
+bool StreamCore::
+getHandler(StreamProtocolParser::Protocol* protocol,
+    const char* handlername, Handler*& handler)
+{
+    StreamBuffer key;
+    StreamBuffer code;
+    Handler* h;
+    Handler** ph;
+
+    key.print("%lu %s %s %s", StreamProtocolParser::generation,
+        protocol->filename(), protocolname(), handlername);
+#ifndef EPICS_3_13
+    sharedHandlersMutex.lock();
+#endif
+    for (h = sharedHandlers; h; h = h->next)
+        if (strcmp(h->key(), key()) == 0) break;
+    if (h && h->verified)
+    {
+        h->refcount++;
+#ifndef EPICS_3_13
+        sharedHandlersMutex.unlock();
+#endif
+        debug("StreamCore::getHandler(%s, %s): shared by %u records\n",
+            name(), handlername, h->refcount);
+        handler = h;
+        return protocol->hasCommands(handlername);
+    }
+#ifndef EPICS_3_13
+    sharedHandlersMutex.unlock();
+#endif
+    if (!protocol->getCommands(handlername, code, this))
+        return false;
+    if (!code) return true;
+#ifndef EPICS_3_13
+    sharedHandlersMutex.lock();
+#endif
+    for (ph = &sharedHandlers; *ph; ph = &(*ph)->next)
+        if (strcmp((*ph)->key(), key()) == 0) break;
+    h = *ph;
+    if (h && h->code.length() == code.length() &&
+        memcmp(h->code(), code(), code.length()) == 0)
+    {
+        h->verified = true;
+        h->refcount++;
+#ifndef EPICS_3_13
+        sharedHandlersMutex.unlock();
+#endif
+        debug("StreamCore::getHandler(%s, %s): sharing code\n",
+            name(), handlername);
+        releaseCommands(code);
+        handler = h;
+        return true;
+    }
+    if (h)
+    {
+        // code depends on the record: do not offer it any more
+        *ph = h->next;
+        h->next = NULL;
+        h = new Handler;
+        h->next = NULL;
+    }
+    else
+    {
+        h = new Handler;
+        h->next = sharedHandlers;
+        sharedHandlers = h;
+        h->key = key;
+    }
+    h->code = code;
+    h->refcount = 1;
+    h->verified = false;
+#ifndef EPICS_3_13
+    sharedHandlersMutex.unlock();
+#endif
+    handler = h;
+    return true;
+}
+
+void StreamCore::
+releaseHandler(Handler*& handler)
+{
+    Handler* h = handler;
+    Handler** ph;
+
+    if (!h) return;
+    handler = NULL;
+#ifndef EPICS_3_13
+    sharedHandlersMutex.lock();
+#endif
+    if (--h->refcount == 0)
+    {
+        for (ph = &sharedHandlers; *ph; ph = &(*ph)->next)
+        {
+            if (*ph == h)
+            {
+                *ph = h->next;
+                break;
+            }
+        }
+    }
+#ifndef EPICS_3_13
+    sharedHandlersMutex.unlock();
+#endif
+    if (h->refcount) return;
+    releaseCommands(h->code);
+    delete h;
+}
+
 void StreamCore::
 printProtocol(FILE* file)
 {
@@ -89,33 +297,38 @@ printProtocol(FILE* file)
     fprintf(file, "%s {\n", protocolname());
     fprintf(file, "  extraInput    = %s;\n",
       (flags & IgnoreExtraInput) ? "ignore" : "error");
+    fprintf(file, "  flushInput    = %s;\n",
+      (flags & KeepInput) ? "no" : "yes");
     fprintf(file, "  lockTimeout   = %ld; # ms\n", lockTimeout);
     fprintf(file, "  readTimeout   = %ld; # ms\n", readTimeout);
     fprintf(file, "  replyTimeout  = %ld; # ms\n", replyTimeout);
     fprintf(file, "  writeTimeout  = %ld; # ms\n", writeTimeout);
     fprintf(file, "  pollPeriod    = %ld; # ms\n", pollPeriod);
     fprintf(file, "  maxInput      = %ld; # bytes\n", maxInput);
+    fprintf(file, "  deadline      = %ld; # ms\n", deadline);
     StreamProtocolParser::printString(buffer.clear(), inTerminator());
     fprintf(file, "  inTerminator  = \"%s\";\n", buffer());
         StreamProtocolParser::printString(buffer.clear(), outTerminator());
     fprintf(file, "  outTerminator = \"%s\";\n", buffer());
         StreamProtocolParser::printString(buffer.clear(), separator());
     fprintf(file, "  separator     = \"%s\";\n", buffer());
+        StreamProtocolParser::printString(buffer.clear(), pollGroup());
+    fprintf(file, "  pollGroup     = \"%s\";\n", buffer());
     if (onInit)
         fprintf(file, "  @Init {\n%s  }\n",
-        printCommands(buffer.clear(), onInit()));
+        printCommands(buffer.clear(), onInit->code()));
     if (onReplyTimeout)
         fprintf(file, "  @ReplyTimeout {\n%s  }\n",
-        printCommands(buffer.clear(), onReplyTimeout()));
+        printCommands(buffer.clear(), onReplyTimeout->code()));
     if (onReadTimeout)
         fprintf(file, "  @ReadTimeout {\n%s  }\n",
-        printCommands(buffer.clear(), onReadTimeout()));
+        printCommands(buffer.clear(), onReadTimeout->code()));
     if (onWriteTimeout)
         fprintf(file, "  @WriteTimeout {\n%s  }\n",
-        printCommands(buffer.clear(), onWriteTimeout()));
+        printCommands(buffer.clear(), onWriteTimeout->code()));
     if (onMismatch)
         fprintf(file, "  @Mismatch {\n%s  }\n",
-        printCommands(buffer.clear(), onMismatch()));
+        printCommands(buffer.clear(), onMismatch->code()));
     fprintf(file, "\n%s}\n",
         printCommands(buffer.clear(), commands()));
 }
@@ -123,11 +336,14 @@ printProtocol(FILE* file)
 ///////////////////////////////////////////////////////////////////////////
 
 StreamCore* StreamCore::first = NULL;
+StreamCore::Handler* StreamCore::sharedHandlers = NULL;
 
 StreamCore::
 StreamCore() : StreamBusInterface::Client(),
     next(), streamname(), flags(None), inTerminatorDefined(), outTerminatorDefined(),
-    activeCommand(end), previousResult(Success), numberOfErrors(0), unparsedInput()
+    onInit(NULL), onWriteTimeout(NULL), onReplyTimeout(NULL),
+    onReadTimeout(NULL), onMismatch(NULL), activeCommand(end), literalOutput(NULL), literalOutputSize(0),
+    previousResult(Success), numberOfErrors(0), unparsedInput()
 {
     businterface = NULL;
     // add myself to list of streams
@@ -141,6 +357,7 @@ StreamCore::
 {
     debug("~StreamCore(%s) %p\n", name(), (void*)this);
     releaseBus();
+    releaseAllCommands();
     // remove myself from list of all streams
     StreamCore** pstream;
     for (pstream = &first; *pstream; pstream = &(*pstream)->next)
@@ -249,15 +466,17 @@ bool StreamCore::
 compile(StreamProtocolParser::Protocol* protocol)
 {
     const char* extraInputNames [] = {"error", "ignore", NULL};
+    const char* flushInputNames [] = {"yes", "no", NULL};
 
     // default values for protocol variables
-    flags &= ~IgnoreExtraInput;
+    flags &= ~(IgnoreExtraInput|KeepInput);
     lockTimeout = 5000;
     readTimeout = 100;
     replyTimeout = 1000;
     writeTimeout = 100;
     maxInput = 0;
     pollPeriod = 1000;
+    deadline = 0;
     inTerminatorDefined = false;
     outTerminatorDefined = false;
 
@@ -268,11 +487,19 @@ compile(StreamProtocolParser::Protocol* protocol)
 
     if (ignoreExtraInput) flags |= IgnoreExtraInput;
 
+    unsigned short keepInput = false;
+    if (!protocol->getEnumVariable("flushinput", keepInput,
+        flushInputNames))
+        return false;
+
+    if (keepInput) flags |= KeepInput;
+
     if (!(protocol->getNumberVariable("locktimeout", lockTimeout) &&
         protocol->getNumberVariable("readtimeout", readTimeout) &&
         protocol->getNumberVariable("replytimeout", replyTimeout) &&
         protocol->getNumberVariable("writetimeout", writeTimeout) &&
         protocol->getNumberVariable("maxinput", maxInput) &&
+        protocol->getNumberVariable("deadline", deadline) &&
         // use replyTimeout as default for pollPeriod
         protocol->getNumberVariable("replytimeout", pollPeriod) &&
         protocol->getNumberVariable("pollperiod", pollPeriod)))
@@ -284,20 +511,63 @@ compile(StreamProtocolParser::Protocol* protocol)
             protocol->getStringVariable("terminator", inTerminator, &inTerminatorDefined)) &&
         (outTerminatorDefined ||
             protocol->getStringVariable("terminator", outTerminator, &outTerminatorDefined)) &&
-        protocol->getStringVariable("separator", separator)))
+        protocol->getStringVariable("separator", separator) &&
+        protocol->getStringVariable("pollgroup", pollGroup)))
         return false;
 
+    // free formats of a previously compiled protocol
+    releaseAllCommands();
+
     if (!(protocol->getCommands(NULL, commands, this) &&
-        protocol->getCommands("@init", onInit, this) &&
-        protocol->getCommands("@writetimeout", onWriteTimeout, this) &&
-        protocol->getCommands("@replytimeout", onReplyTimeout, this) &&
-        protocol->getCommands("@readtimeout", onReadTimeout, this) &&
-        protocol->getCommands("@mismatch", onMismatch, this)))
+        getHandler(protocol, "@init", onInit) &&
+        getHandler(protocol, "@writetimeout", onWriteTimeout) &&
+        getHandler(protocol, "@replytimeout", onReplyTimeout) &&
+        getHandler(protocol, "@readtimeout", onReadTimeout) &&
+        getHandler(protocol, "@mismatch", onMismatch)))
         return false;
 
     return protocol->checkUnused();
 }
 
+// Replace an 'out' command without any formats by the final output
+// bytes including the terminator, so that evalOut() has nothing to do.
+// code layout:
+// out_literal length terminatorlength bytes
+void StreamCore::
+foldLiteralOutput(StreamBuffer& buffer, size_t start)
+{
+    StreamBuffer literal;
+    size_t i;
+
+    for (i = start+1; buffer[i] != StreamProtocolParser::eos; i++)
+    {
+        switch (buffer[i])
+        {
+            case StreamProtocolParser::format:
+            case StreamProtocolParser::format_field:
+                return;
+            case StreamProtocolParser::whitespace:
+                literal.append(' ');
+            case StreamProtocolParser::skip:
+                continue;
+            case esc:
+                // escaped literal byte
+                i++;
+            default:
+                // literal byte
+                literal.append(buffer[i]);
+        }
+    }
+    literal.append(outTerminator);
+    size_t length = literal.length();
+    size_t termlength = outTerminator.length();
+    buffer.truncate(start);
+    buffer.append(out_literal);
+    buffer.append(&length, sizeof(length));
+    buffer.append(&termlength, sizeof(termlength));
+    buffer.append(literal);
+}
+
 bool StreamCore::
 compileCommand(StreamProtocolParser::Protocol* protocol,
     StreamBuffer& buffer, const char* command, const char*& args)
@@ -317,6 +587,7 @@ compileCommand(StreamProtocolParser::Protocol* protocol,
     }
     if (strcmp(command, "out") == 0)
     {
+        size_t start = buffer.length();
         buffer.append(out);
         if (!protocol->compileString(buffer, args,
             PrintFormat, this))
@@ -324,6 +595,7 @@ compileCommand(StreamProtocolParser::Protocol* protocol,
             return false;
         }
         buffer.append(StreamProtocolParser::eos);
+        foldLiteralOutput(buffer, start);
         return true;
     }
     if (strcmp(command, "wait") == 0)
@@ -439,7 +711,7 @@ startProtocol(StartMode startMode)
         case StartInit:
             if (!onInit) return false;
             flags |= InitRun;
-            commandIndex = onInit();
+            commandIndex = onInit->code();
             break;
         case StartAsync:
             if (!busSupportsAsyncRead())
@@ -496,18 +768,18 @@ finishProtocol(ProtocolResult status)
                 handler = NULL;
                 break;
             case WriteTimeout:
-                handler = onWriteTimeout();
+                handler = onWriteTimeout ? onWriteTimeout->code() : NULL;
                 break;
             case ReplyTimeout:
-                handler = onReplyTimeout();
+                handler = onReplyTimeout ? onReplyTimeout->code() : NULL;
                 break;
             case ReadTimeout:
-                handler = onReadTimeout();
+                handler = onReadTimeout ? onReadTimeout->code() : NULL;
                 break;
             case ScanError:
-                handler = onMismatch();
+                handler = onMismatch ? onMismatch->code() : NULL;
                 /* reparse old input if first command in handler is 'in' */
-                if (*handler == in)
+                if (handler && *handler == in)
                 {
                     debug("reparsing input \"%s\"\n",
                         inputLine.expand()());
@@ -567,6 +839,7 @@ evalCommand()
     switch (*commandIndex++)
     {
         case out:
+        case out_literal:
             //// flags &= ~(AcceptInput|AcceptEvent);
             return evalOut();
         case in:
@@ -604,13 +877,27 @@ evalOut()
     // flush all unread input
     unparsedInput = false;
     inputBuffer.clear();
-    if (!formatOutput())
+    if (activeCommand == out_literal)
     {
-        finishProtocol(FormatError);
-        return false;
+        // pre-built at compile time, terminator included
+        literalOutputSize = extract<size_t>(commandIndex);
+        commandIndex += sizeof(size_t); // skip terminator length
+        literalOutput = commandIndex;
+        commandIndex += literalOutputSize;
     }
-    outputLine.append(outTerminator);
-    debug ("StreamCore::evalOut: outputLine = \"%s\"\n", outputLine.expand()());
+    else
+    {
+        if (!formatOutput())
+        {
+            finishProtocol(FormatError);
+            return false;
+        }
+        outputLine.append(outTerminator);
+        literalOutput = NULL;
+    }
+    debug ("StreamCore::evalOut: outputLine = \"%s\"\n", literalOutput ?
+        StreamBuffer(literalOutput, literalOutputSize).expand()() :
+        outputLine.expand()());
     if (*commandIndex == in)  // prepare for early input
     {
         flags |= AcceptInput;
@@ -635,7 +922,10 @@ evalOut()
         return true;
     }
     flags |= WritePending;
-    if (!busWriteRequest(outputLine(), outputLine.length(), writeTimeout))
+    if (!busWriteRequest(
+        literalOutput ? literalOutput : outputLine(),
+        literalOutput ? literalOutputSize : outputLine.length(),
+        writeTimeout))
     {
         return false;
     }
@@ -676,13 +966,8 @@ normal_format:
                 // formatstring <eos> StreamFormat [info]
                 formatstring = commandIndex;
                 // jump after <eos>
-                while (*commandIndex)
-                {
-                    if (*commandIndex == esc) commandIndex++;
-                    commandIndex++;
-                }
-                formatstringlen = commandIndex-formatstring;
-                commandIndex++;
+                commandIndex = skipFormatString(commandIndex);
+                formatstringlen = commandIndex-formatstring-1;
 
                 StreamFormat fmt = extract<StreamFormat>(commandIndex);
                 fmt.info = commandIndex; // point to info string
@@ -739,23 +1024,7 @@ printSeparator()
         return;
     }
     if (!separator) return;
-    size_t i = 0;
-    for (; i < separator.length(); i++)
-    {
-        switch (separator[i])
-        {
-            case StreamProtocolParser::whitespace:
-                outputLine.append(' '); // print single space
-            case StreamProtocolParser::skip:
-                continue;
-            case esc:
-                // escaped literal byte
-                i++;
-            default:
-                // literal byte
-                outputLine.append(separator[i]);
-        }
-    }
+    StreamFormatConverter::printSeparator(separator, outputLine);
 }
 
 bool StreamCore::
@@ -825,6 +1094,31 @@ printValue(const StreamFormat& fmt, char* value)
     return true;
 }
 
+bool StreamCore::
+printArray(const StreamFormat& fmt, const void* values,
+    StreamArrayType type, size_t count)
+{
+    if (fmt.type != unsigned_format && fmt.type != signed_format
+        && fmt.type != enum_format && fmt.type != double_format)
+    {
+        error("%s: printArray() called with %%%c format\n",
+            name(), fmt.conv);
+        return false;
+    }
+    if (count == 0) return true;
+    printSeparator();
+    if (!StreamFormatConverter::find(fmt.conv)->
+        printArray(fmt, outputLine, separator, values, type, count))
+    {
+        error("%s: Formatting array of %" Z "u elements failed\n",
+            name(), count);
+        return false;
+    }
+    debug("StreamCore::printArray(%s, %%%c, %" Z "u elements): \"%s\"\n",
+        name(), fmt.conv, count, outputLine.expand()());
+    return true;
+}
+
 void StreamCore::
 lockCallback(StreamIoStatus status)
 {
@@ -864,7 +1158,10 @@ lockCallback(StreamIoStatus status)
             return;
     }
     flags |= WritePending;
-    if (!busWriteRequest(outputLine(), outputLine.length(), writeTimeout))
+    if (!busWriteRequest(
+        literalOutput ? literalOutput : outputLine(),
+        literalOutput ? literalOutputSize : outputLine.length(),
+        writeTimeout))
     {
         finishProtocol(Fault);
     }
@@ -907,6 +1204,24 @@ getOutTerminator(size_t& length)
     }
 }
 
+bool StreamCore::
+flushInput()
+{
+    return !(flags & KeepInput);
+}
+
+unsigned long StreamCore::
+getDeadline()
+{
+    return deadline;
+}
+
+const char* StreamCore::
+getPollGroup()
+{
+    return pollGroup ? pollGroup() : NULL;
+}
+
 // Handle 'in' command
 
 bool StreamCore::
@@ -998,7 +1313,9 @@ readCallback(StreamIoStatus status,
             }
             if (checkShouldPrint(ReplyTimeout)) {
                 error("%s: No reply within %ld ms to \"%s\"\n",
-                    name(), replyTimeout, outputLine.expand()());
+                    name(), replyTimeout, literalOutput ?
+                    StreamBuffer(literalOutput, literalOutputSize).expand()() :
+                    outputLine.expand()());
             }
             inputBuffer.clear();
             finishProtocol(ReplyTimeout);
@@ -1194,9 +1511,10 @@ matchInput()
 	   @mismatch handler is installed and starts with 'in' (then we reparse the input).
 	   We have previously mismatched the same output (to limit repeating errors)
     */
-    bool printErrors = (!(flags & AsyncMode) && onMismatch[0] != in && !inputLine.startswith(previousMismatch()));
+    bool printErrors = (!(flags & AsyncMode) && !(onMismatch && onMismatch->code[0] == in) && !inputLine.startswith(previousMismatch()));
     char command;
     const char* fieldName = NULL;
+    const char* formatstart = NULL;
     StreamBuffer formatstring;
 
     consumedInput = 0;
@@ -1223,14 +1541,15 @@ normal_format:
                 ssize_t consumed;
                 // code layout:
                 // formatstring <eos> StreamFormat [info]
-                formatstring.clear();
-                commandIndex = StreamProtocolParser::printString(formatstring, commandIndex);
+                // printable formatstring is only needed for messages
+                formatstart = commandIndex;
+                commandIndex = skipFormatString(commandIndex);
 
                 StreamFormat fmt = extract<StreamFormat>(commandIndex);
                 fmt.info = commandIndex; // point to info string
                 commandIndex += fmt.infolen;
                 debug("StreamCore::matchInput(%s): format = \"%%%s\"\n",
-                    name(), formatstring());
+                    name(), printFormat(formatstring, formatstart));
 
                 if (fmt.flags & skip_flag || fmt.type == pseudo_format)
                 {
@@ -1276,7 +1595,7 @@ normal_format:
                                 error("%s: Input \"%s%s\" does not match format \"%%%s\"\n",
                                     name(), inputLine.expand(consumedInput, 20)(),
                                     inputLine.length()-consumedInput > 20 ? "..." : "",
-                                    formatstring());
+                                    printFormat(formatstring, formatstart));
                             }
                             return false;
                         }
@@ -1292,10 +1611,10 @@ normal_format:
                     {
                         if (fieldAddress)
                             error("%s: Cannot format variable \"%s\" with \"%%%s\"\n",
-                                name(), fieldName, formatstring());
+                                name(), fieldName, printFormat(formatstring, formatstart));
                         else
                             error("%s: Cannot format value with \"%%%s\"\n",
-                                name(), formatstring());
+                                name(), printFormat(formatstring, formatstart));
                         return false;
                     }
                     debug("StreamCore::matchInput(%s): compare \"%s\" with \"%s\"\n",
@@ -1310,7 +1629,7 @@ normal_format:
                                 name(),
                                 inputLine.length() > 20 ? "..." : "",
                                 inputLine.expand(-20)(),
-                                formatstring(),
+                                printFormat(formatstring, formatstart),
                                 outputLine.expand()());
                         }
                         return false;
@@ -1322,7 +1641,7 @@ normal_format:
                             error("%s: Input \"%s%s\" does not match format \"%%%s\" (\"%s\")\n",
                                 name(), inputLine.expand(consumedInput, 20)(),
                                 inputLine.length()-consumedInput > 20 ? "..." : "",
-                                formatstring(),
+                                printFormat(formatstring, formatstart),
                                 outputLine.expand()());
                         }
                         return false;
@@ -1339,10 +1658,10 @@ normal_format:
                             error("%s: Input \"%s%s\" does not match format \"%%%s\"\n",
                                 name(), inputLine.expand(consumedInput, 20)(),
                                 inputLine.length()-consumedInput > 20 ? "..." : "",
-                                formatstring());
+                                printFormat(formatstring, formatstart));
                         else
                             error("%s: Format \"%%%s\" has data type %s which is not supported by \"%s\".\n",
-                                name(), formatstring(), StreamFormatTypeStr[fmt.type], fieldAddress ? fieldName : name());
+                                name(), printFormat(formatstring, formatstart), StreamFormatTypeStr[fmt.type], fieldAddress ? fieldName : name());
                     }
                     return false;
                 }
@@ -1450,36 +1769,20 @@ matchSeparator()
         flags |= Separator;
         return true;
     }
-    size_t i;
-    size_t j = consumedInput;
-    for (i = 0; i < separator.length(); i++)
+    ssize_t len = StreamFormatConverter::matchSeparator(separator,
+        inputLine(consumedInput), inputLine.length() - consumedInput);
+    if (len < 0)
     {
-        switch (separator[i])
-        {
-            case StreamProtocolParser::skip:
-                j++;
-                continue;
-            case StreamProtocolParser::whitespace:
-                while (isspace(inputLine[j])) j++;
-                continue;
-            case esc:
-                i++;
-            default:
-                if (separator[i] != inputLine[j])
-                {
-                    // no match
-                    // don't complain here, just return false
-                    debug("StreamCore::matchSeparator(%s) separator \"%s\" not found\n",
-                        name(), separator.expand()());
-                    return false;
-                }
-                j++;
-        }
+        // no match
+        // don't complain here, just return false
+        debug("StreamCore::matchSeparator(%s) separator \"%s\" not found\n",
+            name(), separator.expand()());
+        return false;
     }
     // separator successfully read
     debug("StreamCore::matchSeparator(%s) separator \"%s\" found\n",
         name(), separator.expand()());
-    consumedInput = j;
+    consumedInput += len;
     return true;
 }
 
@@ -1580,6 +1883,34 @@ scanValue(const StreamFormat& fmt, char* value, size_t& size)
     return consumed;
 }
 
+ssize_t StreamCore::
+scanArray(const StreamFormat& fmt, void* values,
+    StreamArrayType type, size_t& count)
+{
+    if (fmt.type != unsigned_format && fmt.type != signed_format
+        && fmt.type != enum_format && fmt.type != double_format)
+    {
+        error("%s: scanArray() called with %%%c format\n",
+            name(), fmt.conv);
+        count = 0;
+        return -1;
+    }
+    flags |= ScanTried;
+    if (!matchSeparator())
+    {
+        count = 0;
+        return -1;
+    }
+    ssize_t consumed = StreamFormatConverter::find(fmt.conv)->
+        scanArray(fmt, inputLine(consumedInput),
+        inputLine.length() - consumedInput, separator, values, type, count);
+    debug("StreamCore::scanArray(%s, format=%%%c) input=\"%s\" %" Z "u elements\n",
+        name(), fmt.conv, inputLine.expand(consumedInput, consumed)(), count);
+    if (count == 0) return -1;
+    flags |= GotValue;
+    return consumed;
+}
+
 const char* StreamCore::
 getInTerminator(size_t& length)
 {
@@ -1820,13 +2151,16 @@ printStatus(StreamBuffer& buffer)
     if (flags & BusOwner)         buffer.append(" BusOwner");
     if (flags & Separator)        buffer.append(" Separator");
     if (flags & ScanTried)        buffer.append(" ScanTried");
+    if (flags & KeepInput)        buffer.append(" KeepInput");
     if (flags & AcceptInput)      buffer.append(" AcceptInput");
     if (flags & AcceptEvent)      buffer.append(" AcceptEvent");
     if (flags & LockPending)      buffer.append(" LockPending");
     if (flags & WritePending)     buffer.append(" WritePending");
     if (flags & WaitPending)      buffer.append(" WaitPending");
     if (flags & Aborted)          buffer.append(" Aborted");
+    size_t length = buffer.append(' ').length();
     busPrintStatus(buffer);
+    if (buffer.length() == length) buffer.truncate(-1);
 }
 
 const char* StreamCore::
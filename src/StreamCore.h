@@ -46,7 +46,8 @@ bool formatValue(const StreamFormat& format, const void* fieldaddress)
   the default location (which may depend on format.type).
   The printValue(format,XXX) function suitable for format.type should be
   called to print value. If value is an array, printValue() should be called
-  for each element. The separator string will be added automatically.
+  for each element or printArray() for all elements of a numeric array.
+  The separator string will be added automatically.
   formatValue() must return true on success and false on failure.
 
 bool matchValue(const StreamFormat& format, const void* fieldaddress)
@@ -56,7 +57,8 @@ bool matchValue(const StreamFormat& format, const void* fieldaddress)
   (which may depend on format.type).
   If value is an array, scanValue() should be called for each element. It
   returns false if there is no more element available. The separator string
-  is matched automatically.
+  is matched automatically. Numeric arrays can be read in one call with
+  scanArray() which updates count with the number of elements read.
   matchValue() must return true on success and false on failure.
 
 
@@ -84,6 +86,7 @@ const unsigned long GotValue         = 0x0008;
 const unsigned long BusOwner         = 0x0010;
 const unsigned long Separator        = 0x0020;
 const unsigned long ScanTried        = 0x0040;
+const unsigned long KeepInput        = 0x0080;
 const unsigned long AcceptInput      = 0x0100;
 const unsigned long AcceptEvent      = 0x0200;
 const unsigned long LockPending      = 0x0400;
@@ -113,7 +116,7 @@ protected:
         StartNormal, StartInit, StartAsync);
 
     ENUM (Commands,
-        end, in, out, wait, event, exec, connect, disconnect);
+        end, in, out, wait, event, exec, connect, disconnect, out_literal);
 
     class MutexLock
     {
@@ -128,8 +131,19 @@ protected:
 
     friend class MutexLock;
 
+    // compiled exception handler, may be shared by many records
+    struct Handler
+    {
+        Handler* next;
+        StreamBuffer key;
+        StreamBuffer code;
+        unsigned int refcount;
+        bool verified;
+    };
+
     StreamCore* next;
     static StreamCore* first;
+    static Handler* sharedHandlers;
 
     char* streamname;
     unsigned long flags;
@@ -148,6 +162,10 @@ protected:
     ssize_t scanValue(const StreamFormat& format, double& value);
     ssize_t scanValue(const StreamFormat& format, char* value, size_t& size);
     ssize_t scanValue(const StreamFormat& format);
+    bool printArray(const StreamFormat& format, const void* values,
+        StreamArrayType type, size_t count);
+    ssize_t scanArray(const StreamFormat& format, void* values,
+        StreamArrayType type, size_t& count);
 
     StreamBuffer protocolname;
     unsigned long lockTimeout;
@@ -156,20 +174,24 @@ protected:
     unsigned long readTimeout;
     unsigned long pollPeriod;
     unsigned long maxInput;
+    unsigned long deadline;
     bool inTerminatorDefined;
     bool outTerminatorDefined;
     StreamBuffer inTerminator;
     StreamBuffer outTerminator;
     StreamBuffer separator;
+    StreamBuffer pollGroup;
     StreamBuffer commands;        // the normal protocol
-    StreamBuffer onInit;          // init protocol (optional)
-    StreamBuffer onWriteTimeout;  // error handler (optional)
-    StreamBuffer onReplyTimeout;  // error handler (optional)
-    StreamBuffer onReadTimeout;   // error handler (optional)
-    StreamBuffer onMismatch;      // error handler (optional)
+    Handler* onInit;              // init protocol (optional)
+    Handler* onWriteTimeout;      // error handler (optional)
+    Handler* onReplyTimeout;      // error handler (optional)
+    Handler* onReadTimeout;       // error handler (optional)
+    Handler* onMismatch;          // error handler (optional)
     const char* commandIndex;     // current position
     char activeCommand;           // current command
     StreamBuffer outputLine;
+    const char* literalOutput;    // pre-built output or NULL for outputLine
+    size_t literalOutputSize;
     StreamBuffer inputBuffer;
     StreamBuffer inputLine;
     size_t consumedInput;
@@ -188,6 +210,10 @@ protected:
 
     StreamCore(const StreamCore&); // undefined
     bool compile(StreamProtocolParser::Protocol*);
+    bool getHandler(StreamProtocolParser::Protocol*,
+        const char* handlername, Handler*& handler);
+    void releaseHandler(Handler*& handler);
+    void foldLiteralOutput(StreamBuffer& buffer, size_t start);
     bool evalCommand();
     bool evalOut();
     bool evalIn();
@@ -220,6 +246,9 @@ protected:
     void disconnectCallback(StreamIoStatus status);
     const char* getInTerminator(size_t& length);
     const char* getOutTerminator(size_t& length);
+    bool flushInput();
+    unsigned long getDeadline();
+    const char* getPollGroup();
 
 // virtual methods
     virtual void protocolStartHook() {}
@@ -242,6 +271,8 @@ public:
 
 private:
     char* printCommands(StreamBuffer& buffer, const char* c);
+    void  releaseCommands(StreamBuffer& code);
+    void  releaseAllCommands();
     bool  checkShouldPrint(ProtocolResult newErrorType);
 };
 
@@ -99,8 +99,35 @@ const unsigned long ValueReceived = 0x0200000;
 extern "C" {
 long streamReload(const char* recordname);
 long streamReportRecord(const char* recordname);
+long streamClearPathCache();
 }
 
+// run @init handlers of different busses at the same time in iocInit
+int streamParallelInit = 0;
+
+// process records in own threads instead of the EPICS callback threads
+int streamCallbackThreads = 0;
+
+#ifndef EPICS_3_13
+class Stream;
+
+// Thread which processes the records of some busses after their
+// protocols have finished. A record has at most one request queued,
+// thus the queue has one entry for each record of the worker.
+struct StreamCallbackWorker
+{
+    epicsMutex mutex;
+    epicsEvent wakeup;
+    Stream** queue;
+    size_t size;        // number of records
+    size_t head;
+    size_t count;
+    size_t maxCount;
+    unsigned long processed;
+    unsigned long overflows;
+};
+#endif
+
 class Stream : protected StreamCore
 #ifndef EPICS_3_13
     , epicsTimerNotify
@@ -125,6 +152,18 @@ class Stream : protected StreamCore
     int convert;
     ssize_t currentValueLength;
     IOSCANPVT ioscanpvt;
+#ifndef EPICS_3_13
+    StreamBuffer initBus;         // "bus addr", one @init at a time
+    Stream* nextInit;             // in runInitHandlers() queue of initBus
+    bool initPending;             // @init deferred in iocInit
+    bool initQueued;              // @init started by runInitHandlers()
+    bool initFinished;
+    static bool deferInit;
+    static epicsEvent* initProgress;
+    StreamCallbackWorker* callbackWorker;
+    static StreamCallbackWorker* callbackWorkers;
+    static int numCallbackWorkers;
+#endif
     CALLBACK commandCallback;
     CALLBACK processCallback;
 
@@ -167,8 +206,18 @@ class Stream : protected StreamCore
     long initRecord(char* linkstring);
     bool print(format_t *format, va_list ap);
     ssize_t scan(format_t *format, void* pvalue, size_t maxStringSize);
+    bool printArray(format_t *format, const void* values,
+        int dbfType, size_t count);
+    ssize_t scanArray(format_t *format, void* values,
+        int dbfType, size_t maxElements);
     bool process();
     static void initHook(initHookState);
+#ifndef EPICS_3_13
+    static void runInitHandlers(bool deferredOnly);
+    static void startCallbackWorkers();
+    static void callbackWorkerThread(void* worker);
+    bool requestCallback();
+#endif
 
 // device support functions
     friend long streamInitRecord(dbCommon *record, const struct link *ioLink,
@@ -179,6 +228,10 @@ class Stream : protected StreamCore
     friend long streamPrintf(dbCommon *record, format_t *format, ...);
     friend ssize_t streamScanfN(dbCommon *record, format_t *format,
         void*, size_t maxStringSize);
+    friend long streamPrintArray(dbCommon *record, format_t *format,
+        const void* values, int dbfType, size_t count);
+    friend ssize_t streamScanArray(dbCommon *record, format_t *format,
+        void* values, int dbfType, size_t maxElements);
     friend long streamReload(const char* recordname);
     friend long streamReportRecord(const char* recordname);
 
@@ -196,6 +249,8 @@ epicsExportAddress(int, streamError);
 epicsExportAddress(int, streamDebugColored);
 epicsExportAddress(int, streamErrorDeadTime);
 epicsExportAddress(int, streamMsgTimeStamped);
+epicsExportAddress(int, streamParallelInit);
+epicsExportAddress(int, streamCallbackThreads);
 }
 
 // for subroutine record
@@ -240,6 +295,12 @@ long streamReload(const char* recordname)
     return OK;
 }
 
+long streamClearPathCache()
+{
+    StreamProtocolParser::clearPathCache();
+    return OK;
+}
+
 long streamSetLogfile(const char* filename)
 {
     FILE *oldfile, *newfile = NULL;
@@ -295,11 +356,20 @@ void streamSetLogfileFunc (const iocshArgBuf *args)
     streamSetLogfile(args[0].sval);
 }
 
+static const iocshFuncDef streamClearPathCacheDef =
+    { "streamClearPathCache", 0, NULL };
+
+void streamClearPathCacheFunc (const iocshArgBuf *)
+{
+    streamClearPathCache();
+}
+
 static void streamRegistrar ()
 {
     iocshRegister(&streamReloadDef, streamReloadFunc);
     iocshRegister(&streamReportRecordDef, streamReportRecordFunc);
     iocshRegister(&streamSetLogfileDef, streamSetLogfileFunc);
+    iocshRegister(&streamClearPathCacheDef, streamClearPathCacheFunc);
     // make streamReload available for subroutine records
     registryFunctionAdd("streamReload",
         (REGISTRYFUNCTION)streamReloadSub);
@@ -371,6 +441,23 @@ report(int interest)
         ++interface;
     }
 
+#ifndef EPICS_3_13
+    if (numCallbackWorkers)
+    {
+        printf("  callback threads:\n");
+        for (int i = 0; i < numCallbackWorkers; i++)
+        {
+            StreamCallbackWorker* worker = &callbackWorkers[i];
+            worker->mutex.lock();
+            printf("    streamCB%d: %" Z "u records, queue %" Z "u "
+                "(max %" Z "u), %lu processed, %lu overflows\n",
+                i, worker->size, worker->count, worker->maxCount,
+                worker->processed, worker->overflows);
+            worker->mutex.unlock();
+        }
+    }
+#endif
+
     if (interest < 1) return OK;
 
     printf("  registered converters:\n");
@@ -474,6 +561,9 @@ drvInit()
         StreamProtocolParser::path);
     StreamPrintTimestampFunction = streamEpicsPrintTimestamp;
     StreamGetThreadNameFunction = epicsThreadGetNameSelf;
+#ifndef EPICS_3_13
+    deferInit = streamParallelInit != 0;
+#endif
     initHookRegister(initHook);
 
     return OK;
@@ -485,6 +575,19 @@ initHook(initHookState state)
     Stream* stream;
 
     switch (state) {
+#ifndef EPICS_3_13
+        case initHookAfterInitDatabase:
+        {
+            startCallbackWorkers();
+            // run the @init handlers deferred by initRecord()
+            if (deferInit)
+            {
+                deferInit = false;
+                runInitHandlers(true);
+            }
+            break;
+        }
+#endif
 #ifdef WITH_IOC_RUN
         case initHookAtIocRun:
         {
@@ -497,18 +600,7 @@ initHook(initHookState state)
                 return;
             }
 
-            for (stream = static_cast<Stream*>(first); stream;
-                stream = static_cast<Stream*>(stream->next))
-            {
-                if (!stream->onInit) continue;
-                debug("%s: running @init handler\n", stream->name());
-                if (!stream->startProtocol(StartInit))
-                {
-                    error("%s: @init handler failed.\n",
-                        stream->name());
-                }
-                stream->initDone.wait();
-            }
+            runInitHandlers(false);
             break;
         }
         case initHookAtIocPause:
@@ -549,6 +641,236 @@ initHook(initHookState state)
     }
 }
 
+#ifndef EPICS_3_13
+bool Stream::deferInit = false;
+epicsEvent* Stream::initProgress = NULL;
+
+// Run the @init handlers of all records (or of those deferred in iocInit).
+// Records on different busses run at the same time, records on the same
+// bus one after the other in record order.
+// Without streamParallelInit, all records run one after the other.
+void Stream::
+runInitHandlers(bool deferredOnly)
+{
+    struct InitQueue
+    {
+        InitQueue* next;
+        const char* bus;
+        Stream* first;
+        Stream** last;
+        Stream* current;
+        unsigned long total;
+        unsigned long done;
+        unsigned long failed;
+    };
+    InitQueue* queues = NULL;
+    InitQueue** lastQueue = &queues;
+    InitQueue* q;
+    Stream* stream;
+    unsigned long total = 0;
+    unsigned long running = 0;
+    bool reported = false;
+    epicsEvent progress;
+    epicsTime startTime = epicsTime::getCurrent();
+
+    for (stream = static_cast<Stream*>(first); stream;
+        stream = static_cast<Stream*>(stream->next))
+    {
+        if (deferredOnly ? !stream->initPending :
+            !stream->onInit) continue;
+        stream->initPending = false;
+        const char* bus = streamParallelInit ? stream->initBus() : "";
+        for (q = queues; q; q = q->next)
+            if (strcmp(q->bus, bus) == 0) break;
+        if (!q)
+        {
+            q = new InitQueue;
+            q->next = NULL;
+            q->bus = bus;
+            q->first = NULL;
+            q->last = &q->first;
+            q->current = NULL;
+            q->total = q->done = q->failed = 0;
+            *lastQueue = q;
+            lastQueue = &q->next;
+        }
+        stream->nextInit = NULL;
+        *q->last = stream;
+        q->last = &stream->nextInit;
+        q->total++;
+        total++;
+    }
+    if (!total) return;
+    initProgress = &progress;
+    while (1)
+    {
+        for (q = queues; q; q = q->next)
+        {
+            if ((stream = q->current) != NULL)
+            {
+                stream->lockMutex();
+                bool finished = stream->initFinished;
+                stream->releaseMutex();
+                if (!finished) continue;
+                q->current = NULL;
+                q->done++;
+                running--;
+                if (stream->status != NO_ALARM)
+                {
+                    q->failed++;
+                    if (deferredOnly) stream->record->stat = stream->status;
+                    error("%s: @init handler failed\n",
+                        stream->name());
+                }
+            }
+            // start the next record of this bus
+            while (!q->current && (stream = q->first) != NULL)
+            {
+                q->first = stream->nextInit;
+                if (!q->first) q->last = &q->first;
+                debug("%s: running @init handler\n", stream->name());
+                stream->initFinished = false;
+                stream->initQueued = true;
+                if (stream->startProtocol(StartInit))
+                {
+                    q->current = stream;
+                    running++;
+                    break;
+                }
+                stream->initQueued = false;
+                q->done++;
+                q->failed++;
+                error("%s: @init handler failed.\n",
+                    stream->name());
+            }
+        }
+        if (!running) break;
+        if (progress.wait(10.0)) continue;
+        // taking long: report progress of each bus
+        reported = true;
+        printf("streamDevice: @init running for %.0f s\n",
+            epicsTime::getCurrent() - startTime);
+        for (q = queues; q; q = q->next)
+        {
+            printf("  %s: %lu of %lu done, %lu failed%s%s\n",
+                q->bus[0] ? q->bus : "all busses",
+                q->done, q->total, q->failed,
+                q->current ? ", running " : "",
+                q->current ? q->current->name() : "");
+        }
+    }
+    initProgress = NULL;
+    if (reported)
+        printf("streamDevice: @init of %lu records done in %.0f s\n",
+            total, epicsTime::getCurrent() - startTime);
+    while (queues)
+    {
+        q = queues;
+        queues = q->next;
+        delete q;
+    }
+}
+
+StreamCallbackWorker* Stream::callbackWorkers = NULL;
+int Stream::numCallbackWorkers = 0;
+
+// Start streamCallbackThreads threads to process the records.
+// All records of a bus use the same thread, distributed by bus name.
+void Stream::
+startCallbackWorkers()
+{
+    int n = streamCallbackThreads;
+    int i;
+    Stream* stream;
+    StreamCallbackWorker* worker;
+    char threadname[16];
+
+    if (n <= 0 || callbackWorkers) return;
+    callbackWorkers = new StreamCallbackWorker[n];
+    for (stream = static_cast<Stream*>(first); stream;
+        stream = static_cast<Stream*>(stream->next))
+    {
+        unsigned long hash = 0;
+        const char* p;
+        for (p = stream->initBus(); *p; p++)
+            hash = hash * 31 + (unsigned char)*p;
+        stream->callbackWorker = &callbackWorkers[hash % n];
+        stream->callbackWorker->size++;
+    }
+    for (i = 0; i < n; i++)
+    {
+        worker = &callbackWorkers[i];
+        worker->queue = new Stream*[worker->size ? worker->size : 1];
+        worker->head = 0;
+        worker->count = 0;
+        worker->maxCount = 0;
+        worker->processed = 0;
+        worker->overflows = 0;
+        sprintf(threadname, "streamCB%d", i);
+        if (!epicsThreadCreate(threadname, epicsThreadPriorityScanHigh,
+            epicsThreadGetStackSize(epicsThreadStackMedium),
+            callbackWorkerThread, worker))
+        {
+            error("Can't start thread %s. "
+                "Using EPICS callback threads instead.\n", threadname);
+            for (stream = static_cast<Stream*>(first); stream;
+                stream = static_cast<Stream*>(stream->next))
+            {
+                if (stream->callbackWorker == worker)
+                    stream->callbackWorker = NULL;
+            }
+        }
+    }
+    numCallbackWorkers = n;
+}
+
+void Stream::
+callbackWorkerThread(void* arg)
+{
+    StreamCallbackWorker* worker = static_cast<StreamCallbackWorker*>(arg);
+    Stream* stream;
+
+    while (1)
+    {
+        worker->wakeup.wait();
+        worker->mutex.lock();
+        while (worker->count)
+        {
+            stream = worker->queue[worker->head];
+            worker->head = (worker->head + 1) % worker->size;
+            worker->count--;
+            worker->processed++;
+            worker->mutex.unlock();
+            stream->recordProcessCallback();
+            worker->mutex.lock();
+        }
+        worker->mutex.unlock();
+    }
+}
+
+// Queue the record in its callback thread.
+// Returns false if the queue is full. (Should not happen.)
+bool Stream::
+requestCallback()
+{
+    StreamCallbackWorker* worker = callbackWorker;
+
+    worker->mutex.lock();
+    if (worker->count >= worker->size)
+    {
+        worker->overflows++;
+        worker->mutex.unlock();
+        return false;
+    }
+    worker->queue[(worker->head + worker->count) % worker->size] = this;
+    if (++worker->count > worker->maxCount)
+        worker->maxCount = worker->count;
+    worker->mutex.unlock();
+    worker->wakeup.signal();
+    return true;
+}
+#endif
+
 // device support (C interface) //////////////////////////////////////////
 
 long streamInit(int after)
@@ -711,6 +1033,24 @@ ssize_t streamScanfN(dbCommon* record, format_t *format,
     return size;
 }
 
+long streamPrintArray(dbCommon *record, format_t *format,
+    const void* values, int dbfType, size_t count)
+{
+    debug("streamPrintArray(%s,format=%%%c,count=%" Z "u)\n",
+        record->name, format->priv->conv, count);
+    Stream* stream = static_cast<Stream*>(record->dpvt);
+    if (!stream) return ERROR;
+    return stream->printArray(format, values, dbfType, count) ? OK : ERROR;
+}
+
+ssize_t streamScanArray(dbCommon *record, format_t *format,
+    void* values, int dbfType, size_t maxElements)
+{
+    Stream* stream = static_cast<Stream*>(record->dpvt);
+    if (!stream) return ERROR;
+    return stream->scanArray(format, values, dbfType, maxElements);
+}
+
 // Stream methods ////////////////////////////////////////////////////////
 
 Stream::
@@ -736,6 +1076,13 @@ Stream(dbCommon* _record, const struct link *ioLink,
     status = ERROR;
     convert = DO_NOT_CONVERT;
     ioscanpvt = NULL;
+#ifndef EPICS_3_13
+    nextInit = NULL;
+    initPending = false;
+    initQueued = false;
+    initFinished = false;
+    callbackWorker = NULL;
+#endif
 }
 
 Stream::
@@ -832,6 +1179,9 @@ initRecord(char* linkstring /* modifiable copy */)
             name(), busname, addr);
         return S_dev_noDevice;
     }
+#ifndef EPICS_3_13
+    initBus.clear().print("%s %ld", busname, addr);
+#endif
 
     // parse protocol file
     debug("Stream::initRecord %s: parse(\"%s\", \"%s\")\n",
@@ -871,6 +1221,16 @@ initRecord(char* linkstring /* modifiable copy */)
 
     if (!onInit) return DO_NOT_CONVERT; // no @init handler, keep DOL
 
+#ifndef EPICS_3_13
+    if (deferInit)
+    {
+        // streamParallelInit: run later together with the other records
+        debug("Stream::initRecord %s: @init deferred\n", name());
+        initPending = true;
+        return DO_NOT_CONVERT;
+    }
+#endif
+
     // initialize the record from hardware
     if (!startProtocol(StartInit))
     {
@@ -970,6 +1330,77 @@ print(format_t *format, va_list ap)
     }
 }
 
+static bool arrayType(int dbfType, StreamArrayType& type)
+{
+    switch (dbfType)
+    {
+        case DBF_CHAR:
+            type = int8_array;
+            return true;
+        case DBF_UCHAR:
+            type = uint8_array;
+            return true;
+        case DBF_SHORT:
+        case DBF_ENUM:
+            type = int16_array;
+            return true;
+        case DBF_USHORT:
+            type = uint16_array;
+            return true;
+        case DBF_LONG:
+            type = int32_array;
+            return true;
+        case DBF_ULONG:
+            type = uint32_array;
+            return true;
+        case DBF_FLOAT:
+            type = float32_array;
+            return true;
+        case DBF_DOUBLE:
+            type = float64_array;
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool Stream::
+printArray(format_t *format, const void* values, int dbfType, size_t count)
+{
+    // called by streamPrintArray
+    StreamArrayType type;
+    if (!arrayType(dbfType, type))
+    {
+        error("INTERNAL ERROR (%s): Illegal array type %d\n",
+            name(), dbfType);
+        return false;
+    }
+    return StreamCore::printArray(*format->priv, values, type, count);
+}
+
+ssize_t Stream::
+scanArray(format_t *format, void* values, int dbfType, size_t maxElements)
+{
+    // called by streamScanArray
+    StreamArrayType type;
+    size_t count = maxElements;
+    if (!arrayType(dbfType, type))
+    {
+        error("INTERNAL ERROR (%s): Illegal array type %d\n",
+            name(), dbfType);
+        return ERROR;
+    }
+    consumedInput += currentValueLength;
+    currentValueLength = 0;
+    ssize_t consumed = StreamCore::scanArray(*format->priv, values, type, count);
+    debug("Stream::scanArray() %" Z "u elements, %" Z "d bytes\n",
+        count, consumed);
+    if (consumed < 0) return ERROR;
+    // Don't remove scanned values from inputLine yet, like in scan()
+    currentValueLength = consumed;
+    return count;
+}
+
 ssize_t Stream::
 scan(format_t *format, void* value, size_t maxStringSize)
 {
@@ -1079,6 +1510,16 @@ protocolFinishHook(ProtocolResult result)
             break;
 
     }
+#ifndef EPICS_3_13
+    if ((flags & InitRun) && initQueued)
+    {
+        debug("Stream::protocolFinishHook %s: signalling init progress\n", name());
+        initQueued = false;
+        initFinished = true;
+        initProgress->signal();
+        return;
+    }
+#endif
     if ((flags & (InitRun|Aborted)) == InitRun && record->proc != 2)
     {
         debug("Stream::protocolFinishHook %s: signalling init done\n", name());
@@ -1099,6 +1540,9 @@ protocolFinishHook(ProtocolResult result)
     if (record->pact || record->scan == SCAN_IO_EVENT)
     {
         // process record in callback thread to break possible recursion
+#ifndef EPICS_3_13
+        if (callbackWorker && requestCallback()) return;
+#endif
         callbackSetPriority(priority(), &processCallback);
         callbackRequest(&processCallback);
     }
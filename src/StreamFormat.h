@@ -47,6 +47,17 @@ typedef enum {
 
 extern const char* StreamFormatTypeStr[];
 
+typedef enum {
+    int8_array = 1,
+    uint8_array,
+    int16_array,
+    uint16_array,
+    int32_array,
+    uint32_array,
+    float32_array,
+    float64_array
+} StreamArrayType;
+
 typedef struct StreamFormat
 {
     char conv;
@@ -24,6 +24,11 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <limits.h>
+#include <float.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "StreamFormatConverter.h"
 #include "StreamError.h"
@@ -238,6 +243,332 @@ scanPseudo(const StreamFormat& fmt, StreamBuffer&, size_t&)
     return -1;
 }
 
+void StreamFormatConverter::
+release(const StreamFormat&)
+{
+}
+
+// Generic array support: one virtual call per element
+
+class VirtualConverter
+{
+    StreamFormatConverter* converter;
+public:
+    VirtualConverter(StreamFormatConverter* converter) : converter(converter) {}
+    bool operator()(const StreamFormat& fmt, StreamBuffer& output, long value)
+        { return converter->printLong(fmt, output, value); }
+    bool operator()(const StreamFormat& fmt, StreamBuffer& output, double value)
+        { return converter->printDouble(fmt, output, value); }
+    ssize_t operator()(const StreamFormat& fmt, const char* input, long& value)
+        { return converter->scanLong(fmt, input, value); }
+    ssize_t operator()(const StreamFormat& fmt, const char* input, double& value)
+        { return converter->scanDouble(fmt, input, value); }
+};
+
+bool StreamFormatConverter::
+printArray(const StreamFormat& fmt, StreamBuffer& output,
+    const StreamBuffer& separator, const void* values,
+    StreamArrayType type, size_t count)
+{
+    if (fmt.type == double_format)
+        return printElements<double>(VirtualConverter(this), fmt, output,
+            separator, values, type, count);
+    return printElements<long>(VirtualConverter(this), fmt, output,
+        separator, values, type, count);
+}
+
+ssize_t StreamFormatConverter::
+scanArray(const StreamFormat& fmt, const char* input, size_t length,
+    const StreamBuffer& separator, void* values,
+    StreamArrayType type, size_t& count)
+{
+    if (fmt.type == double_format)
+        return scanElements<double>(VirtualConverter(this), fmt, input,
+            length, separator, values, type, count);
+    return scanElements<long>(VirtualConverter(this), fmt, input,
+        length, separator, values, type, count);
+}
+
+void StreamFormatConverter::
+printSeparator(const StreamBuffer& separator, StreamBuffer& output)
+{
+    size_t i;
+    for (i = 0; i < separator.length(); i++)
+    {
+        switch (separator[i])
+        {
+            case StreamProtocolParser::whitespace:
+                output.append(' '); // print single space
+            case StreamProtocolParser::skip:
+                continue;
+            case esc:
+                // escaped literal byte
+                i++;
+            default:
+                // literal byte
+                output.append(separator[i]);
+        }
+    }
+}
+
+ssize_t StreamFormatConverter::
+matchSeparator(const StreamBuffer& separator, const char* input, size_t length)
+{
+    size_t i;
+    size_t j = 0;
+    for (i = 0; i < separator.length(); i++)
+    {
+        switch (separator[i])
+        {
+            case StreamProtocolParser::skip:
+                if (j >= length) return -1;
+                j++;
+                continue;
+            case StreamProtocolParser::whitespace:
+                while (j < length && isspace(input[j])) j++;
+                continue;
+            case esc:
+                i++;
+            default:
+                if (j >= length || separator[i] != input[j]) return -1;
+                j++;
+        }
+    }
+    return j;
+}
+
+void StreamFormatConverter::
+loadElement(const void* values, StreamArrayType type, size_t index, long& value)
+{
+    switch (type)
+    {
+        case int8_array:
+            value = static_cast<const signed char*>(values)[index];
+            break;
+        case uint8_array:
+            value = static_cast<const unsigned char*>(values)[index];
+            break;
+        case int16_array:
+            value = static_cast<const short*>(values)[index];
+            break;
+        case uint16_array:
+            value = static_cast<const unsigned short*>(values)[index];
+            break;
+        case int32_array:
+            value = static_cast<const int*>(values)[index];
+            break;
+        case uint32_array:
+            value = static_cast<const unsigned int*>(values)[index];
+            break;
+        case float32_array:
+            value = (long)static_cast<const float*>(values)[index];
+            break;
+        case float64_array:
+            value = (long)static_cast<const double*>(values)[index];
+            break;
+    }
+}
+
+void StreamFormatConverter::
+loadElement(const void* values, StreamArrayType type, size_t index, double& value)
+{
+    switch (type)
+    {
+        case float32_array:
+            value = static_cast<const float*>(values)[index];
+            break;
+        case float64_array:
+            value = static_cast<const double*>(values)[index];
+            break;
+        default:
+        {
+            long lval;
+            loadElement(values, type, index, lval);
+            value = lval;
+        }
+    }
+}
+
+void StreamFormatConverter::
+storeElement(void* values, StreamArrayType type, size_t index, long value)
+{
+    switch (type)
+    {
+        case int8_array:
+        case uint8_array:
+            static_cast<char*>(values)[index] = (char)value;
+            break;
+        case int16_array:
+        case uint16_array:
+            static_cast<short*>(values)[index] = (short)value;
+            break;
+        case int32_array:
+        case uint32_array:
+            static_cast<int*>(values)[index] = (int)value;
+            break;
+        case float32_array:
+            static_cast<float*>(values)[index] = (float)value;
+            break;
+        case float64_array:
+            static_cast<double*>(values)[index] = (double)value;
+            break;
+    }
+}
+
+void StreamFormatConverter::
+storeElement(void* values, StreamArrayType type, size_t index, double value)
+{
+    switch (type)
+    {
+        case float32_array:
+            static_cast<float*>(values)[index] = (float)value;
+            break;
+        case float64_array:
+            static_cast<double*>(values)[index] = value;
+            break;
+        default:
+            storeElement(values, type, index, (long)value);
+    }
+}
+
+size_t StreamFormatConverter::
+elementSize(StreamArrayType type)
+{
+    switch (type)
+    {
+        case int8_array:
+        case uint8_array:
+            return 1;
+        case int16_array:
+        case uint16_array:
+            return 2;
+        case int32_array:
+        case uint32_array:
+        case float32_array:
+            return 4;
+        case float64_array:
+            return 8;
+    }
+    return 0;
+}
+
+bool StreamFormatConverter::
+hostIsLittleEndian()
+{
+    union {short s; char c[sizeof(short)];} u;
+    u.s = 1;
+    return u.c[0] != 0;
+}
+
+// Copy count elements of size 1, 2, 4 or 8 bytes from raw input
+// to values, optionally reversing the byte order of each element.
+void StreamFormatConverter::
+copySwapped(void* values, const char* input, size_t count, size_t size, bool swap)
+{
+    char* dest = static_cast<char*>(values);
+    size_t i = 0;
+    size_t j;
+
+    if (!swap || size == 1)
+    {
+        memcpy(dest, input, count * size);
+        return;
+    }
+#ifdef __SSE2__
+    // 16 bytes per step: swap bytes in 16 bit words,
+    // then reorder words for 4 and 8 byte elements
+    size_t n = count * size / 16;
+    for (; i < n; i++)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input) + i);
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        if (size == 4)
+        {
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2,3,0,1));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2,3,0,1));
+        }
+        else if (size == 8)
+        {
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0,1,2,3));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0,1,2,3));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest) + i, v);
+    }
+    i = i * 16 / size;
+#endif
+    for (; i < count; i++)
+    {
+        for (j = 0; j < size; j++)
+            dest[i*size + j] = input[i*size + size-1-j];
+    }
+}
+
+// Up to maxStops bytes can be searched in parallel by spanString
+static const size_t maxStops = 6;
+
+#if defined(__SSE2__) && defined(__GNUC__)
+// Aligned 16 byte loads never cross a page boundary but may read beyond
+// the terminating null byte (like strlen does), which confuses ASan.
+#if defined(__SANITIZE_ADDRESS__)
+__attribute__((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+__attribute__((no_sanitize_address))
+#endif
+#endif
+static size_t spanString(const char* input, size_t maxlen,
+    const char* stops, size_t nstops)
+{
+    // Return length of the initial segment of input (at most maxlen)
+    // which contains neither a null byte nor any of the stop bytes.
+    size_t offset = (size_t)input & 15;
+    const char* block = input - offset;
+    __m128i zero = _mm_setzero_si128();
+    __m128i s[maxStops];
+    unsigned int mask = 0xffffu << offset;
+    size_t i;
+
+    for (i = 0; i < nstops; i++)
+        s[i] = _mm_set1_epi8(stops[i]);
+    while (1)
+    {
+        __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+        __m128i hit = _mm_cmpeq_epi8(v, zero);
+        for (i = 0; i < nstops; i++)
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, s[i]));
+        unsigned int bits = _mm_movemask_epi8(hit) & mask;
+        if (bits)
+        {
+            size_t n = block + __builtin_ctz(bits) - input;
+            return n < maxlen ? n : maxlen;
+        }
+        block += 16;
+        if ((size_t)(block - input) >= maxlen) return maxlen;
+        mask = 0xffff;
+    }
+}
+#else
+static size_t spanString(const char* input, size_t maxlen,
+    const char* stops, size_t nstops)
+{
+    size_t n;
+    for (n = 0; n < maxlen && input[n]; n++)
+        if (memchr(stops, input[n], nstops)) break;
+    return n;
+}
+#endif
+
+// Copy a scanned string of length n to value, respecting space_left
+// and keeping space for the terminal null byte.
+static void copyString(char*& value, size_t& space_left, const char* input, size_t n)
+{
+    if (space_left <= 1) return;
+    if (n > space_left - 1) n = space_left - 1;
+    memcpy(value, input, n);
+    value += n;
+    space_left -= n;
+}
+
 static void copyFormatString(StreamBuffer& info, const char* source)
 {
     const char* p = source - 1;
@@ -256,37 +587,29 @@ static void copyFormatString(StreamBuffer& info, const char* source)
 
 // Standard Long Converter for 'diouxX'
 
-static ssize_t prepareval(const StreamFormat& fmt, const char*& input, bool& neg)
+static ssize_t prepareval(const StreamFormat& fmt, const char*& input, bool& neg, size_t& width)
 {
+    // width is the number of bytes left for the number after the sign
+    // or (size_t)-1 if unlimited
     size_t consumed = 0;
     neg = false;
+    width = fmt.width ? fmt.width : (size_t)-1;
     while (isspace(*input)) { input++; consumed++; }
-    if (fmt.width)
-    {
-        // take local copy because strto* don't have width parameter
-        size_t width = fmt.width;
-        if (fmt.flags & space_flag)
-        {
-            // normally whitespace does not count to width
-            // but do so if space flag is present
-            width -= consumed;
-        }
-        strncpy((char*)fmt.info, input, width);
-        ((char*)fmt.info)[width] = 0;
-        input = fmt.info;
-    }
-    if (*input == '+')
+    if (fmt.width && (fmt.flags & space_flag))
     {
-        goto skipsign;
+        // normally whitespace does not count to width
+        // but do so if space flag is present
+        if (consumed >= width) return -1;
+        width -= consumed;
     }
-    if (*input == '-')
+    if (width && (*input == '+' || *input == '-'))
     {
-        neg = true;
-skipsign:
+        neg = *input == '-';
         input++;
         consumed++;
+        width--;
     }
-    if (isspace(*input))
+    if (width && isspace(*input))
     {
         // allow space after sign only if # flag is set
         if (!(fmt.flags & alt_flag)) return -1;
@@ -294,11 +617,62 @@ skipsign:
     return consumed;
 }
 
+// Like strtoul() but reads at most width bytes directly from input
+// instead of requiring a terminated copy.
+// Returns number of consumed bytes or 0 if no digits were found.
+static size_t scanUnsigned(const char* input, size_t width, int base, unsigned long& value)
+{
+    size_t consumed = 0;
+    size_t start;
+    unsigned long v = 0;
+    bool overflow = false;
+    unsigned int digit;
+
+    while (consumed < width && isspace(input[consumed])) consumed++;
+    if ((base == 0 || base == 16) && input[consumed] == '0'
+        && consumed + 2 < width
+        && (input[consumed+1] == 'x' || input[consumed+1] == 'X')
+        && isxdigit(input[consumed+2]))
+    {
+        base = 16;
+        consumed += 2;
+    }
+    else if (base == 0)
+    {
+        base = input[consumed] == '0' ? 8 : 10;
+    }
+    start = consumed;
+    while (consumed < width)
+    {
+        char c = input[consumed];
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'z') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'Z') digit = c - 'A' + 10;
+        else break;
+        if (digit >= (unsigned int)base) break;
+        if (v > (ULONG_MAX - digit) / base) overflow = true;
+        v = v * base + digit;
+        consumed++;
+    }
+    if (consumed == start) return 0;
+    // saturate like strtoul
+    value = overflow ? ULONG_MAX : v;
+    return consumed;
+}
+
 class StdLongConverter : public StreamFormatConverter
 {
     int parse(const StreamFormat& fmt, StreamBuffer& output, const char*& value, bool scanFormat);
     bool printLong(const StreamFormat& fmt, StreamBuffer& output, long value);
     ssize_t scanLong(const StreamFormat& fmt, const char* input, long& value);
+    bool printArray(const StreamFormat& fmt, StreamBuffer& output,
+        const StreamBuffer& separator, const void* values,
+        StreamArrayType type, size_t count);
+    ssize_t scanArray(const StreamFormat& fmt, const char* input, size_t length,
+        const StreamBuffer& separator, void* values,
+        StreamArrayType type, size_t& count);
+    static bool print(const StreamFormat& fmt, StreamBuffer& output, long value);
+    static ssize_t scan(const StreamFormat& fmt, const char* input, long& value);
 };
 
 int StdLongConverter::
@@ -311,11 +685,7 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
             fmt.prec, fmt.conv);
         return false;
     }
-    if (scanFormat)
-    {
-        if (fmt.width) info.reserve(fmt.width+1);
-    }
-    else
+    if (!scanFormat)
     {
         copyFormatString(info, source);
         info.append('l');
@@ -329,6 +699,36 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
 
 bool StdLongConverter::
 printLong(const StreamFormat& fmt, StreamBuffer& output, long value)
+{
+    return print(fmt, output, value);
+}
+
+ssize_t StdLongConverter::
+scanLong(const StreamFormat& fmt, const char* input, long& value)
+{
+    return scan(fmt, input, value);
+}
+
+bool StdLongConverter::
+printArray(const StreamFormat& fmt, StreamBuffer& output,
+    const StreamBuffer& separator, const void* values,
+    StreamArrayType type, size_t count)
+{
+    return printElements<long>(print, fmt, output,
+        separator, values, type, count);
+}
+
+ssize_t StdLongConverter::
+scanArray(const StreamFormat& fmt, const char* input, size_t length,
+    const StreamBuffer& separator, void* values,
+    StreamArrayType type, size_t& count)
+{
+    return scanElements<long>(scan, fmt, input,
+        length, separator, values, type, count);
+}
+
+bool StdLongConverter::
+print(const StreamFormat& fmt, StreamBuffer& output, long value)
 {
     // limits %x/%X formats to number of half bytes in width.
     if (fmt.width && (fmt.conv == 'x' || fmt.conv == 'X') && fmt.width < 2*sizeof(long))
@@ -338,15 +738,15 @@ printLong(const StreamFormat& fmt, StreamBuffer& output, long value)
 }
 
 ssize_t StdLongConverter::
-scanLong(const StreamFormat& fmt, const char* input, long& value)
+scan(const StreamFormat& fmt, const char* input, long& value)
 {
-    char* end;
     ssize_t consumed;
+    size_t width, n;
     bool neg;
     int base;
-    long v;
+    unsigned long v;
 
-    consumed = prepareval(fmt, input, neg);
+    consumed = prepareval(fmt, input, neg, width);
     if (consumed < 0) return -1;
     switch (fmt.conv)
     {
@@ -367,9 +767,9 @@ scanLong(const StreamFormat& fmt, const char* input, long& value)
         default:
             base = 0;
     }
-    v = strtoul(input, &end, base);
-    if (end == input) return -1;
-    consumed += end-input;
+    n = scanUnsigned(input, width, base, v);
+    if (n == 0) return -1;
+    consumed += n;
     value = neg ? -v : v;
     return consumed;
 }
@@ -383,6 +783,12 @@ class StdDoubleConverter : public StreamFormatConverter
     virtual int parse(const StreamFormat&, StreamBuffer&, const char*&, bool);
     virtual bool printDouble(const StreamFormat&, StreamBuffer&, double);
     virtual ssize_t scanDouble(const StreamFormat&, const char*, double&);
+    virtual bool printArray(const StreamFormat&, StreamBuffer&,
+        const StreamBuffer&, const void*, StreamArrayType, size_t);
+    virtual ssize_t scanArray(const StreamFormat&, const char*, size_t,
+        const StreamBuffer&, void*, StreamArrayType, size_t&);
+    static bool print(const StreamFormat&, StreamBuffer&, double);
+    static ssize_t scan(const StreamFormat&, const char*, double&);
 };
 
 int StdDoubleConverter::
@@ -395,11 +801,7 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
             fmt.prec, fmt.conv);
         return false;
     }
-    if (scanFormat)
-    {
-        if (fmt.width) info.reserve(fmt.width+1);
-    }
-    else
+    if (!scanFormat)
     {
         copyFormatString(info, source);
         info.append(fmt.conv);
@@ -409,24 +811,168 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
 
 bool StdDoubleConverter::
 printDouble(const StreamFormat& fmt, StreamBuffer& output, double value)
+{
+    return print(fmt, output, value);
+}
+
+ssize_t StdDoubleConverter::
+scanDouble(const StreamFormat& fmt, const char* input, double& value)
+{
+    return scan(fmt, input, value);
+}
+
+bool StdDoubleConverter::
+printArray(const StreamFormat& fmt, StreamBuffer& output,
+    const StreamBuffer& separator, const void* values,
+    StreamArrayType type, size_t count)
+{
+    return printElements<double>(print, fmt, output,
+        separator, values, type, count);
+}
+
+ssize_t StdDoubleConverter::
+scanArray(const StreamFormat& fmt, const char* input, size_t length,
+    const StreamBuffer& separator, void* values,
+    StreamArrayType type, size_t& count)
+{
+    return scanElements<double>(scan, fmt, input,
+        length, separator, values, type, count);
+}
+
+bool StdDoubleConverter::
+print(const StreamFormat& fmt, StreamBuffer& output, double value)
 {
     output.print(fmt.info, value);
     return true;
 }
 
+// Exact fast path for the common case of decimal numbers with at most
+// 15 significant digits and a small exponent (Clinger's algorithm):
+// Mantissa and power of 10 are both exact doubles, thus one
+// multiplication or division gives the correctly rounded result.
+// Everything else (more digits, large exponents, hex, inf, nan)
+// returns 0 and is left to strtod.
+// Requires that the FPU does not use extended precision for doubles.
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+static const double exactPowersOf10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static size_t scanDecimal(const char* input, size_t width, double& value)
+{
+    size_t i = 0;
+    bool neg = false;
+    bool digits = false;
+    int ndigits = 0;
+    long exponent = 0;
+    double mantissa = 0.0;
+
+    // accept the same syntax as strtod
+    while (i < width && isspace(input[i])) i++;
+    if (i < width && (input[i] == '+' || input[i] == '-'))
+    {
+        neg = input[i] == '-';
+        i++;
+    }
+    if (i+1 < width && input[i] == '0' && (input[i+1] == 'x' || input[i+1] == 'X'))
+        return 0; // hex float
+    for (; i < width && isdigit(input[i]); i++)
+    {
+        digits = true;
+        if (mantissa == 0.0 && input[i] == '0') continue;
+        if (++ndigits > 15) return 0;
+        mantissa = mantissa * 10 + (input[i] - '0');
+    }
+    if (i < width && input[i] == '.')
+    {
+        for (i++; i < width && isdigit(input[i]); i++)
+        {
+            digits = true;
+            exponent--;
+            if (mantissa == 0.0 && input[i] == '0') continue;
+            if (++ndigits > 15) return 0;
+            mantissa = mantissa * 10 + (input[i] - '0');
+        }
+    }
+    if (!digits) return 0; // inf, nan or not a number
+    if (i+1 < width && (input[i] == 'e' || input[i] == 'E'))
+    {
+        size_t j = i+1;
+        bool negexp = false;
+        long e = 0;
+        if (input[j] == '+' || input[j] == '-')
+        {
+            negexp = input[j] == '-';
+            j++;
+        }
+        if (j < width && isdigit(input[j]))
+        {
+            for (; j < width && isdigit(input[j]); j++)
+            {
+                if (e > 10000) return 0;
+                e = e * 10 + (input[j] - '0');
+            }
+            exponent += negexp ? -e : e;
+            i = j;
+        }
+    }
+    if (mantissa != 0.0)
+    {
+        if (exponent < -22) return 0;
+        if (exponent > 22)
+        {
+            // shift powers into the mantissa while it stays exact
+            if (exponent > 22 + 15 - ndigits) return 0;
+            mantissa *= exactPowersOf10[exponent - 22];
+            exponent = 22;
+        }
+        if (exponent < 0)
+            mantissa /= exactPowersOf10[-exponent];
+        else
+            mantissa *= exactPowersOf10[exponent];
+    }
+    value = neg ? -mantissa : mantissa;
+    return i;
+}
+#else
+static size_t scanDecimal(const char*, size_t, double&)
+{
+    return 0;
+}
+#endif
+
 ssize_t StdDoubleConverter::
-scanDouble(const StreamFormat& fmt, const char* input, double& value)
+scan(const StreamFormat& fmt, const char* input, double& value)
 {
     char* end;
     ssize_t consumed;
+    size_t width, n;
     bool neg;
 
-    consumed = prepareval(fmt, input, neg);
+    consumed = prepareval(fmt, input, neg, width);
     if (consumed < 0) return -1;
-    value = strtod(input, &end);
+    n = scanDecimal(input, width, value);
+    if (n == 0)
+    {
+        if (fmt.width)
+        {
+            // take local copy because strtod has no width parameter
+            n = 0;
+            while (n < width && input[n]) n++;
+            StreamBuffer buffer(input, n);
+            value = strtod(buffer(), &end);
+            n = end - buffer();
+        }
+        else
+        {
+            value = strtod(input, &end);
+            n = end - input;
+        }
+        if (n == 0) return -1;
+    }
     if (neg) value = -value;
-    if (end == input) return -1;
-    consumed += end-input;
+    consumed += n;
     return consumed;
 }
 
@@ -519,19 +1065,15 @@ scanString(const StreamFormat& fmt, const char* input,
         consumed++;
         input++;
     }
-    while (*input && width)
+    if (width)
     {
         // normally whitespace ends string
         // but don't end if # flag is present
-        if (!(fmt.flags & alt_flag) && isspace((unsigned char)*input)) break;
-        if (space_left > 1)
-        {
-            *value++ = *input;
-            space_left--;
-        }
-        consumed++;
-        width--;
-        input++;
+        static const char whitespace[] = " \t\n\v\f\r";
+        size_t n = spanString(input, width, whitespace,
+            (fmt.flags & alt_flag) ? 0 : sizeof(whitespace)-1);
+        copyString(value, space_left, input, n);
+        consumed += n;
     }
     if (space_left)
     {
@@ -632,7 +1174,7 @@ class StdCharsetConverter : public StreamFormatConverter
 
 inline void markbit(StreamBuffer& info, bool notflag, char c)
 {
-    char &infobyte = info[c>>3];
+    char &infobyte = info[(unsigned char)c>>3];
     char mask = 1<<(c&7);
 
     if (notflag)
@@ -674,7 +1216,7 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
     }
     else
     {
-        memset(info(1), 255, 32);
+        memset(info(), 255, 32);
     }
     if (*source == ']')
     {
@@ -702,6 +1244,17 @@ parse(const StreamFormat& fmt, StreamBuffer& info,
     }
     source++; // consume ']'
 
+    // With only a few stop bytes (like in %[^\r]) list them for spanString,
+    // else mark with 0xff to test the bitmap.
+    StreamBuffer stops;
+    int c1;
+    for (c1 = 1; c1 < 256 && stops.length() <= maxStops; c1++)
+        if (info[c1>>3] & 1<<(c1&7)) stops.append(c1);
+    if (stops.length() <= maxStops)
+        info.append((char)stops.length()).append(stops);
+    else
+        info.append('\xff');
+
     return string_format;
 }
 
@@ -718,18 +1271,24 @@ scanString(const StreamFormat& fmt, const char* input,
     // if user does not specify width assume "infinity" (-1)
     if (width == 0) width = -1;
 
-    while (*input && width)
+    const unsigned char* bitmap = (const unsigned char*)fmt.info;
+    size_t nstops = bitmap[32];
+    if (nstops <= maxStops)
     {
-        if (fmt.info[*input>>3] & 1<<(*input&7)) break;
-        if (space_left > 1) // keep space for terminal null byte
+        consumed = spanString(input, width, fmt.info+33, nstops);
+    }
+    else
+    {
+        const unsigned char* p = (const unsigned char*)input;
+        while (*p && width)
         {
-            *value++ = *input;
-            space_left--;
+            if (bitmap[*p>>3] & 1<<(*p&7)) break;
+            width--;
+            p++;
         }
-        consumed++;
-        width--;
-        input++;
+        consumed = p - (const unsigned char*)input;
     }
+    copyString(value, space_left, input, consumed);
     if (space_left)
     {
         *value = '\0';
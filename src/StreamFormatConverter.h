@@ -67,6 +67,38 @@ public:
         const char* input, char* value, size_t& size);
     virtual ssize_t scanPseudo(const StreamFormat& fmt,
         StreamBuffer& inputLine, size_t& cursor);
+    virtual bool printArray(const StreamFormat& fmt,
+        StreamBuffer& output, const StreamBuffer& separator,
+        const void* values, StreamArrayType type, size_t count);
+    virtual ssize_t scanArray(const StreamFormat& fmt,
+        const char* input, size_t length, const StreamBuffer& separator,
+        void* values, StreamArrayType type, size_t& count);
+    virtual void release(const StreamFormat& fmt);
+    static void printSeparator(const StreamBuffer& separator,
+        StreamBuffer& output);
+    static ssize_t matchSeparator(const StreamBuffer& separator,
+        const char* input, size_t length);
+protected:
+    static void loadElement(const void* values, StreamArrayType type,
+        size_t index, long& value);
+    static void loadElement(const void* values, StreamArrayType type,
+        size_t index, double& value);
+    static void storeElement(void* values, StreamArrayType type,
+        size_t index, long value);
+    static void storeElement(void* values, StreamArrayType type,
+        size_t index, double value);
+    static size_t elementSize(StreamArrayType type);
+    static bool hostIsLittleEndian();
+    static void copySwapped(void* values, const char* input,
+        size_t count, size_t size, bool swap);
+    template <class T, class Printer>
+    static bool printElements(Printer print, const StreamFormat& fmt,
+        StreamBuffer& output, const StreamBuffer& separator,
+        const void* values, StreamArrayType type, size_t count);
+    template <class T, class Scanner>
+    static ssize_t scanElements(Scanner scan, const StreamFormat& fmt,
+        const char* input, size_t length, const StreamBuffer& separator,
+        void* values, StreamArrayType type, size_t& count);
 };
 
 inline StreamFormatConverter* StreamFormatConverter::
@@ -74,6 +106,66 @@ find(unsigned char c) {
     return registered[c];
 }
 
+// Loop over array elements for printArray() implementations.
+// print(fmt, output, value) is called for each element.
+template <class T, class Printer>
+bool StreamFormatConverter::
+printElements(Printer print, const StreamFormat& fmt,
+    StreamBuffer& output, const StreamBuffer& separator,
+    const void* values, StreamArrayType type, size_t count)
+{
+    T value;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (i > 0) printSeparator(separator, output);
+        loadElement(values, type, i, value);
+        if (!print(fmt, output, value)) return false;
+    }
+    return true;
+}
+
+// Loop over array elements for scanArray() implementations.
+// scan(fmt, input, value) is called for each element.
+// Stops at the first element that cannot be read.
+template <class T, class Scanner>
+ssize_t StreamFormatConverter::
+scanElements(Scanner scan, const StreamFormat& fmt,
+    const char* input, size_t length, const StreamBuffer& separator,
+    void* values, StreamArrayType type, size_t& count)
+{
+    size_t consumed = 0;
+    size_t n = 0;
+    size_t fixwidth = fmt.type == double_format ?
+        fmt.width + fmt.prec + 1 : fmt.width;
+    ssize_t len;
+    T value;
+
+    while (n < count)
+    {
+        if (n > 0)
+        {
+            len = matchSeparator(separator, input + consumed, length - consumed);
+            if (len < 0) break;
+            consumed += len;
+        }
+        len = scan(fmt, input + consumed, value);
+        if (len < 0)
+        {
+            if (!(fmt.flags & default_flag)) break;
+            value = 0;
+            len = 0;
+        }
+        if (fmt.flags & fix_width_flag && (size_t)len != fixwidth) break;
+        if ((size_t)len > length - consumed) break;
+        storeElement(values, type, n++, value);
+        consumed += len;
+    }
+    count = n;
+    return consumed;
+}
+
 #define RegisterConverter(converter, conversions) \
 template class StreamFormatConverterRegistrar<converter>; \
 StreamFormatConverterRegistrar<converter> \
@@ -151,6 +243,23 @@ void* ref_##converter = &registrar_##converter\
 * to update size.
 * Return -1 on failure.
 *
+* printArray(), scanArray()
+* =========================
+* Optional. Print or scan a whole array of count elements of the given type
+* at once. Elements are separated by separator. printArray() returns true on
+* success. scanArray() reads at most count elements from the length bytes
+* of input, updates count with the number of elements read and returns the
+* number of consumed bytes.
+* The default implementations call print*() or scan*() for each element.
+* Override them if your converter can do better, using the printElements()
+* and scanElements() helpers with a non-virtual print or scan function.
+*
+* release()
+* =========
+* Optional. Called when a compiled protocol is discarded, for example by
+* streamReload. Free here whatever parse() has allocated and stored in info.
+* The default implementation does nothing.
+*
 *
 * Register your class
 * ===================
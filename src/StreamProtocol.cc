@@ -28,6 +28,13 @@
 #include "StreamFormatConverter.h"
 #include "StreamError.h"
 
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#define WITH_PATH_CACHE
+#endif
+
 const char* StreamFormatTypeStr[] = {
     // must match the order in StreamFormat.h
     "none", "unsigned", "signed", "enum", "double", "string", "pseudo"
@@ -54,6 +61,7 @@ class StreamProtocolParser::Protocol::Variable
 
 StreamProtocolParser* StreamProtocolParser::parsers = NULL;
 const char* StreamProtocolParser::path = NULL;
+unsigned long StreamProtocolParser::generation = 0;
 static const char* specialChars = " ,;{}=()$'\"+-*/";
 
 // Client destructor
@@ -99,11 +107,9 @@ report()
     }
 }
 
-// API function: read protocol from file, create parser if necessary
-// RETURNS: a copy of a protocol that must be deleted by the caller
-// SIDEEFFECTS: file IO, memory allocation for parsers
-StreamProtocolParser::Protocol* StreamProtocolParser::
-getProtocol(const char* filename, const StreamBuffer& protocolAndParams)
+// Find already parsed file or read it
+StreamProtocolParser* StreamProtocolParser::
+findParser(const char* filename)
 {
     StreamProtocolParser* parser;
 
@@ -118,20 +124,197 @@ getProtocol(const char* filename, const StreamBuffer& protocolAndParams)
                     filename);
                 return NULL;
             }
-            break;
+            return parser;
         }
     }
+    // If not, read it.
+    return readFile(filename);
+}
+
+// API function: read protocol from file, create parser if necessary
+// RETURNS: a copy of a protocol that must be deleted by the caller
+// SIDEEFFECTS: file IO, memory allocation for parsers
+StreamProtocolParser::Protocol* StreamProtocolParser::
+getProtocol(const char* filename, const StreamBuffer& protocolAndParams)
+{
+    StreamProtocolParser* parser = findParser(filename);
     if (!parser)
     {
-        // If not, read it.
-        parser = readFile(filename);
-        if (!parser)
+        // We could not read the file.
+        return NULL;
+    }
+    return parser->getProtocol(protocolAndParams);
+}
+
+// API function: get names of all protocols in a file
+// RETURNS: false if file could not be read
+// SIDEEFFECTS: file IO, memory allocation for parsers
+bool StreamProtocolParser::
+listProtocols(const char* filename, StreamBuffer& names)
+{
+    StreamProtocolParser* parser = findParser(filename);
+    Protocol* protocol;
+
+    if (!parser) return false;
+    names.clear();
+    for (protocol = parser->protocols; protocol; protocol = protocol->next)
+    {
+        names.append(protocol->protocolname()).append('\0');
+    }
+    return true;
+}
+
+#ifdef WITH_PATH_CACHE
+// Cache of the directory contents in STREAM_PROTOCOL_PATH.
+// On slow (network) file systems, failing fopen() calls for each
+// directory in the path and for each protocol file are expensive.
+// Thus read every directory only once and remember which files it contains.
+// The directories are checked for modifications only once after each
+// free(), i.e. once per streamReload, not for every file.
+// File names are compared ignoring case, because the file system may do so.
+// Files which are not found in any listing are still tried with fopen()
+// and are remembered as missing until the next free().
+
+// modification times with nanoseconds, where available
+#if defined(__APPLE__)
+#define MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#elif defined(st_mtime)
+// st_mtime is st_mtim.tv_sec
+#define MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+
+struct StreamProtocolDir
+{
+    StreamProtocolDir* next;
+    StreamBuffer name;
+    StreamBuffer files; // \0file1\0file2\0...fileN\0 in lower case
+    time_t mtime;
+#ifdef MTIME_NSEC
+    long mtimeNsec;
+#endif
+    unsigned long checked; // generation of last check
+    bool exists;
+    bool valid;
+};
+
+static StreamProtocolDir* protocolDirs = NULL;
+static StreamBuffer missingFiles; // \0file1\0file2\0...fileN\0
+static unsigned long missingFilesGeneration;
+
+static void appendLowerCase(StreamBuffer& buffer, const char* s)
+{
+    while (*s) buffer.append((char)tolower((unsigned char)*s++));
+}
+
+enum { NoDir, Unlisted, Listed };
+
+// Returns Listed if filename may exist in dirname, NoDir if dirname
+// does not exist and Unlisted if filename is not in its listing.
+static int fileInDir(const char* dirname, const char* filename)
+{
+    StreamProtocolDir* d;
+    struct stat st;
+    DIR* dir;
+    struct dirent* entry;
+    StreamBuffer key;
+
+    // we only know the top level of each directory
+    if (strchr(filename, '/')) return Listed;
+    if (!dirname[0]) dirname = ".";
+    for (d = protocolDirs; d; d = d->next)
+    {
+        if (strcmp(d->name(), dirname) == 0) break;
+    }
+    if (!d)
+    {
+        d = new StreamProtocolDir;
+        d->name = dirname;
+        d->valid = false;
+        d->checked = StreamProtocolParser::generation - 1;
+        d->next = protocolDirs;
+        protocolDirs = d;
+    }
+    if (d->checked != StreamProtocolParser::generation)
+    {
+        d->checked = StreamProtocolParser::generation;
+        d->exists = stat(dirname, &st) == 0;
+        if (!d->exists)
         {
-            // We could not read the file.
-            return NULL;
+            debug("StreamProtocolParser::readFile: no directory '%s'\n",
+                dirname);
+            d->valid = false;
+        }
+        else if (!d->valid || d->mtime != st.st_mtime
+#ifdef MTIME_NSEC
+            || d->mtimeNsec != MTIME_NSEC(st)
+#endif
+            )
+        {
+            debug("StreamProtocolParser::readFile: scan directory '%s'\n",
+                dirname);
+            d->files.clear();
+            d->mtime = st.st_mtime;
+#ifdef MTIME_NSEC
+            d->mtimeNsec = MTIME_NSEC(st);
+#endif
+            d->valid = false;
+            dir = opendir(dirname);
+            if (dir)
+            {
+                d->files.append('\0');
+                while ((entry = readdir(dir)) != NULL)
+                {
+                    appendLowerCase(d->files, entry->d_name);
+                    d->files.append('\0');
+                }
+                closedir(dir);
+                d->valid = true;
+            }
         }
     }
-    return parser->getProtocol(protocolAndParams);
+    if (!d->exists) return NoDir;
+    // cannot list the directory, but files may still be readable
+    if (!d->valid) return Listed;
+    key.append('\0');
+    appendLowerCase(key, filename);
+    key.append('\0');
+    return d->files.find(key) >= 0 ? Listed : Unlisted;
+}
+
+// Returns true if filename has not been found since the last free().
+static bool fileIsMissing(const char* filename, bool add)
+{
+    StreamBuffer key;
+
+    if (missingFilesGeneration != StreamProtocolParser::generation)
+    {
+        missingFiles.clear();
+        missingFilesGeneration = StreamProtocolParser::generation;
+    }
+    key.append('\0').append(filename).append('\0');
+    if (missingFiles.find(key) >= 0) return true;
+    if (add)
+    {
+        if (!missingFiles) missingFiles.append('\0');
+        missingFiles.append(filename).append('\0');
+    }
+    return false;
+}
+#endif
+
+// API function: forget cached directory contents of STREAM_PROTOCOL_PATH
+void StreamProtocolParser::
+clearPathCache()
+{
+#ifdef WITH_PATH_CACHE
+    StreamProtocolDir* d;
+    while ((d = protocolDirs) != NULL)
+    {
+        protocolDirs = d->next;
+        delete d;
+    }
+    missingFiles.clear();
+#endif
 }
 
 // API function: free all parser resources allocated by any getProtocol()
@@ -141,6 +324,7 @@ free()
 {
     delete parsers;
     parsers = NULL;
+    generation++;
 }
 
 /*
@@ -154,15 +338,60 @@ No coding of parameters, commands, functions, or formats yet. We'll do
 this after protocol arguments have been replaced.
 */
 
-StreamProtocolParser* StreamProtocolParser::
-readFile(const char* filename)
+// Look for filename in every dir in search path.
+// With the path cache only in dirs where fileInDir() returns which.
+static FILE* openInPath(const char* filename, int which)
 {
     FILE* file = NULL;
-    StreamProtocolParser* parser;
     const char *p;
     size_t n;
     StreamBuffer dir;
 
+    for (p = StreamProtocolParser::path; *p; p += n)
+    {
+        dir.clear();
+        // allow ':' or ';' for OS independence
+        // we need to be careful with drive letters though
+        n = strcspn(p, ":;");
+#ifdef _WIN32
+        if (n == 1 && p[1] == ':' && isalpha(p[0]))
+        {
+            // driver letter
+            n = 2 + strcspn(p+2, ":;");
+        }
+#endif
+        dir.append(p, n);
+        // append / after everything except empty path [or drive letter]
+        // Windows is fine with / as well
+        if (n) {
+#ifdef _WIN32
+            if (n != 2 || p[1] != ':' || !isalpha(p[0]))
+#endif
+            dir.append('/');
+        }
+        if (p[n]) n++; // skip the path separator
+#ifdef WITH_PATH_CACHE
+        if (fileInDir(dir(), filename) != which)
+            continue;
+#endif
+        dir.append(filename);
+        // try to read the file
+        debug("StreamProtocolParser::readFile: try '%s'\n", dir());
+        file = fopen(dir(), "r");
+        if (file) {
+            debug("StreamProtocolParser::readFile: found '%s'\n", dir());
+            break;
+        }
+    }
+    return file;
+}
+
+StreamProtocolParser* StreamProtocolParser::
+readFile(const char* filename)
+{
+    FILE* file = NULL;
+    StreamProtocolParser* parser;
+
     // no path or absolute file name
     if (!path || filename[0] == '/'
 #ifdef _WIN32
@@ -178,39 +407,18 @@ readFile(const char* filename)
             return NULL;
         }
     } else {
-        // look for filename in every dir in search path
-        for (p = path; *p; p += n)
+#ifdef WITH_PATH_CACHE
+        // first in directories which list the file, then in the others,
+        // in case the listing does not show the name like fopen() sees it
+        if (!fileIsMissing(filename, false))
         {
-            dir.clear();
-            // allow ':' or ';' for OS independence
-            // we need to be careful with drive letters though
-            n = strcspn(p, ":;");
-#ifdef _WIN32
-            if (n == 1 && p[1] == ':' && isalpha(p[0]))
-            {
-                // driver letter
-                n = 2 + strcspn(p+2, ":;");
-            }
-#endif
-            dir.append(p, n);
-            // append / after everything except empty path [or drive letter]
-            // Windows is fine with / as well
-            if (n) {
-#ifdef _WIN32
-                if (n != 2 || p[1] != ':' || !isalpha(p[0]))
-#endif
-                dir.append('/');
-            }
-            if (p[n]) n++; // skip the path separator
-            dir.append(filename);
-            // try to read the file
-            debug("StreamProtocolParser::readFile: try '%s'\n", dir());
-            file = fopen(dir(), "r");
-            if (file) {
-                debug("StreamProtocolParser::readFile: found '%s'\n", dir());
-                break;
-            }
+            file = openInPath(filename, Listed);
+            if (!file) file = openInPath(filename, Unlisted);
+            if (!file) fileIsMissing(filename, true);
         }
+#else
+        file = openInPath(filename, -1);
+#endif
         if (!file) {
             error("Can't find readable file '%s' in '%s'\n", filename, path);
             return NULL;
@@ -729,6 +937,44 @@ format:         {
     return ++s;
 }
 
+// Let converters free what they have allocated for the formats in string.
+const char* StreamProtocolParser::
+releaseFormats(const char* s)
+{
+    while (*s)
+    {
+        switch (*s)
+        {
+            case esc:
+                ++s;
+                break;
+            case format_field:
+                // <format_field> field <eos> addrLength AddressStructure formatstr <eos> StreamFormat [info <eos>]
+                unsigned short fieldSize;
+                ++s;
+                while (*s++);
+                fieldSize = extract<unsigned short>(s);
+                s += fieldSize; // skip fieldAddress
+                goto format;
+            case format:
+                // <format> formatstr <eos> StreamFormat [info <eos>]
+                s++;
+format:         {
+                    s = releaseFormats(s); // skip formatstr
+                    StreamFormat f = extract<StreamFormat>(s);
+                    f.info = s;
+                    StreamFormatConverter* converter =
+                        StreamFormatConverter::find(f.conv);
+                    if (converter) converter->release(f);
+                    s += f.infolen;
+                }
+                continue;
+        }
+        ++s;
+    }
+    return ++s;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // StreamProtocolParser::Protocol::Variable
 
@@ -958,10 +1204,12 @@ getCommands(const char* handlername, StreamBuffer& code, Client* client)
                 "in handler '%s'\n", handlername);
             error(variables->line, filename(),
                 "used by protocol '%s'\n", protocolname());
+            code.clear();
             return false;
         }
         error(pvar->line, filename(),
             "in protocol '%s'\n", protocolname());
+        code.clear();
         return false;
     }
     debug2("commands %s: %s\n", handlername, pvar->value.expand()());
@@ -969,6 +1217,14 @@ getCommands(const char* handlername, StreamBuffer& code, Client* client)
     return true;
 }
 
+// Like getCommands() but without compiling. Marks the handler as used.
+bool StreamProtocolParser::Protocol::
+hasCommands(const char* handlername)
+{
+    const Variable* pvar = getVariable(handlername);
+    return pvar && pvar->value;
+}
+
 bool StreamProtocolParser::Protocol::
 replaceVariable(StreamBuffer& buffer, const char* varname)
 {
@@ -74,6 +74,7 @@ public:
             const char ** enumstrings);
         bool getStringVariable(const char* varname,StreamBuffer& value, bool* defined = NULL);
         bool getCommands(const char* handlername, StreamBuffer& code, Client*);
+        bool hasCommands(const char* handlername);
         bool compileNumber(unsigned long& number, const char*& source,
             unsigned long max = 0xFFFFFFFF);
         bool compileString(StreamBuffer& buffer, const char*& source,
@@ -113,6 +114,7 @@ private:
     bool isGlobalContext(const StreamBuffer* commands);
     bool isHandlerContext(Protocol&, const StreamBuffer* commands);
     static StreamProtocolParser* readFile(const char* file);
+    static StreamProtocolParser* findParser(const char* file);
     bool parseProtocol(Protocol&, StreamBuffer* commands);
     int readChar();
     bool readToken(StreamBuffer& buffer,
@@ -126,9 +128,13 @@ protected:
 public:
     static Protocol* getProtocol(const char* file,
         const StreamBuffer& protocolAndParams);
+    static bool listProtocols(const char* file, StreamBuffer& names);
     static void free();
+    static void clearPathCache();
     static const char* path;
+    static unsigned long generation;
     static const char* printString(StreamBuffer&, const char* string);
+    static const char* releaseFormats(const char* string);
     void report();
 };
 
@@ -157,9 +163,20 @@ PURPOSE: read protocol from file, create parser if necessary
 RETURNS: a copy of a protocol that must be deleted by the caller
 SIDEEFFECTS: file IO, memory allocation for parser
 
+NAME: listProtocols()
+PURPOSE: get the names of all protocols in a file, separated by '\0'
+RETURNS: false if the file cannot be read
+SIDEEFFECTS: file IO, memory allocation for parser
+
 NAME: free()
 PURPOSE: free all parser resources allocated by getProtocol()
 Call this function once after the last getProtocol() to clean up.
+SIDEEFFECTS: increments generation, so that code compiled from
+  the freed protocols can be told apart from code compiled later
+
+NAME: clearPathCache()
+PURPOSE: forget the cached contents of the directories in path
+Directories are checked for modifications once after each free().
 
 */
 
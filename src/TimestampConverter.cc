@@ -23,6 +23,9 @@
 #include <time.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
 #include <errno.h>
 
 #include "StreamFormatConverter.h"
@@ -73,20 +76,298 @@ int timezone = 0;
 #define localtime_r(timet,tm) (*(tm)=*localtime(timet))
 #endif
 
+
+/* The format is compiled in parse() into a list of operations, for output
+   or for input, so that the format string is not interpreted for every
+   value. Numeric fields, %s, %z and fractions are converted directly,
+   other fields like month names are left to strftime().
+   localtime_r(), tzset() and mktime() may read the time zone file each
+   time. Thus their results are cached until the second changes.
+*/
+
+static const char opLiteral = '"';  // input must match text
+static const char opConstant = '%'; // %%, %n, %t: input must match value
+static const char opStrftime = '$'; // output text with strftime()
+static const char opSpace = ' ';    // skip any whitespace in input
+static const char opZone = '+';     // time zone in format like %+0100
+static const char opFraction = '0'; // fractional seconds like %09f
+static const char opFail = '!';     // bad fraction format
+static const char opUnknown = '?';  // unknown conversion in input format
+
+struct TimestampOp
+{
+    TimestampOp* next;
+    TimestampOp* sub;   // for shortcuts like %T in input formats
+    char code;          // conversion character or one of the op codes
+    long value;         // digits of fraction, time zone or constant
+    StreamBuffer text;  // literal string or strftime format
+    TimestampOp(char code, long value = 0)
+        : next(NULL), sub(NULL), code(code), value(value) {}
+    ~TimestampOp() { delete sub; delete next; }
+};
+
+struct TimestampFormat
+{
+    TimestampOp* ops;
+    // output: broken down time of the last printed second
+    time_t printSecond;
+    bool printValid;
+    struct tm printTime;
+    long utcOffset;
+    // input: time zone and "today" of the current second
+    time_t now;
+    bool nowValid;
+    struct tm today;
+    long zone;
+    // input: last mktime() result, for any second of that minute
+    bool mktimeValid;
+    struct tm mktimeKey;
+    time_t mktimeBase;
+
+    TimestampFormat(TimestampOp* ops) : ops(ops),
+        printValid(false), nowValid(false) {}
+    ~TimestampFormat() { delete ops; }
+};
+
+/* seconds since 1970 of a broken down time as if it was UTC */
+static time_t civilSeconds(const struct tm& tm)
+{
+    long y = tm.tm_year + 1900L + tm.tm_mon / 12;
+    long m = tm.tm_mon % 12;
+    if (m < 0) { m += 12; y--; }
+    // days from 1970-01-01 with years starting in March
+    if (m < 2) y--;
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (m < 2 ? m + 10 : m - 2) + 2) / 5 + tm.tm_mday - 1;
+    long days = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+    return (time_t)days * 86400 + tm.tm_hour * 3600L + tm.tm_min * 60L + tm.tm_sec;
+}
+
+class TimestampOpList
+{
+    TimestampOp* first;
+    TimestampOp** tail;
+    TimestampOp* literal;
+public:
+    TimestampOpList() : first(NULL), tail(&first), literal(NULL) {}
+    TimestampOp* add(TimestampOp* op)
+    {
+        // op may be a list itself
+        *tail = op;
+        while (*tail) tail = &(*tail)->next;
+        literal = NULL;
+        return op;
+    }
+    void addLiteral(char c)
+    {
+        if (!literal)
+        {
+            TimestampOp* op = new TimestampOp(opLiteral);
+            add(op);
+            literal = op;
+        }
+        literal->text.append(c);
+    }
+    TimestampOp* get() { return first; }
+};
+
+static TimestampOp* compilePrint(const char* format)
+{
+    TimestampOpList ops;
+    char* end;
+
+    while (*format)
+    {
+        if (*format != '%' || !format[1])
+        {
+            ops.addLiteral(*format++);
+            continue;
+        }
+        const char* start = format++;
+        if (*format == '0')
+        {
+            unsigned long n = strtoul(format, &end, 10);
+            if (*end == 'f')
+            {
+                ops.add(new TimestampOp(opFraction, n));
+                format = end + 1;
+                continue;
+            }
+        }
+        switch (*format)
+        {
+            case '%':
+                ops.addLiteral('%');
+                break;
+            case 'n':
+                ops.addLiteral('\n');
+                break;
+            case 't':
+                ops.addLiteral('\t');
+                break;
+            case 'Y':
+            case 'y':
+            case 'm':
+            case 'd':
+            case 'e':
+            case 'j':
+            case 'H':
+            case 'k':
+            case 'I':
+            case 'l':
+            case 'M':
+            case 'S':
+            case 's':
+#if !defined(_WIN32) && !defined(vxWorks)
+            /* elsewhere strftime may print the zone name for %z */
+            case 'z':
+#endif
+                ops.add(new TimestampOp(*format));
+                break;
+            case 'F':
+                ops.add(compilePrint("%Y-%m-%d"));
+                break;
+            case 'T':
+                ops.add(compilePrint("%H:%M:%S"));
+                break;
+            case 'R':
+                ops.add(compilePrint("%H:%M"));
+                break;
+            case 'D':
+                ops.add(compilePrint("%m/%d/%y"));
+                break;
+            default:
+            {
+                /* names and locale dependent formats: use strftime */
+                while (strchr("_-0^#", *format)) format++;
+                while (isdigit(*format)) format++;
+                while (*format == 'E' || *format == 'O') format++;
+                if (!*format) format--;
+                TimestampOp* op = ops.add(new TimestampOp(opStrftime));
+                op->text.append(start, format + 1 - start).append('\0');
+            }
+        }
+        format++;
+    }
+    return ops.get();
+}
+
+static int nummatch(const char*& input, int min, int max);
+
+static TimestampOp* compileScan(const char* format)
+{
+    TimestampOpList ops;
+    TimestampOp* op;
+    char* end;
+    int i;
+
+    while (*format)
+    {
+        switch (*format)
+        {
+            case '%':
+                format++;
+                /* Modifiers (ignore) */
+                while (*format == 'E' || *format == 'O') format++;
+                switch (*format)
+                {
+                    case 0: /* stray % at end of format string */
+                        ops.add(new TimestampOp(opConstant, '%'));
+                        continue;
+                    case '%':
+                        ops.add(new TimestampOp(opConstant, '%'));
+                        break;
+                    case 'n':
+                        ops.add(new TimestampOp(opConstant, '\n'));
+                        break;
+                    case 't':
+                        ops.add(new TimestampOp(opConstant, '\t'));
+                        break;
+                    case '0': /* fractions of seconds like %09f */
+                        i = strtol(format, &end, 10);
+                        format = end;
+                        if (*format != 'f')
+                        {
+                            ops.add(new TimestampOp(opFail));
+                            if (!*format) continue;
+                            break;
+                        }
+                        ops.add(new TimestampOp(opFraction, i));
+                        break;
+                    case '+': /* set time zone in format string */
+                    case '-':
+                        i = nummatch(format, -2400, 2400);
+                        ops.add(new TimestampOp(opZone, i));
+                        continue;
+                /* shortcuts */
+                    case 'c':
+                        op = ops.add(new TimestampOp('c'));
+                        op->sub = compileScan("%a %b %d %H:%M:%S %Y");
+                        break;
+                    case 'D':
+                    case 'x':
+                        op = ops.add(new TimestampOp(*format));
+                        op->sub = compileScan("%m/%d/%y");
+                        break;
+                    case 'F':
+                        op = ops.add(new TimestampOp('F'));
+                        op->sub = compileScan("%Y-%m-%d");
+                        break;
+                    case 'R':
+                        op = ops.add(new TimestampOp('R'));
+                        op->sub = compileScan("%H:%M");
+                        break;
+                    case 'T':
+                        op = ops.add(new TimestampOp('T'));
+                        op->sub = compileScan("%H:%M:%S");
+                        break;
+                    case 'X':
+                    case 'r':
+                        op = ops.add(new TimestampOp(*format));
+                        op->sub = compileScan("%I:%M:%S %p");
+                        break;
+                    default:
+                        if (*format && strchr("AauwUWVjZbhBmdeYyCHkIlPpMSsz", *format))
+                        {
+                            ops.add(new TimestampOp(*format));
+                            break;
+                        }
+                        op = ops.add(new TimestampOp(opUnknown));
+                        op->text.append(format).append('\0');
+                }
+                format++;
+                break;
+            case ' ':
+                ops.add(new TimestampOp(opSpace));
+                format++;
+                break;
+            default:
+                ops.addLiteral(*format++);
+        }
+    }
+    return ops.get();
+}
+
 class TimestampConverter : public StreamFormatConverter
 {
     int parse(const StreamFormat&, StreamBuffer&, const char*&, bool);
     bool printDouble(const StreamFormat&, StreamBuffer&, double);
     ssize_t scanDouble(const StreamFormat&, const char*, double&);
+    void release(const StreamFormat&);
 };
 
+// info format: <TimestampFormat*><format string>0
+
 int TimestampConverter::
 parse(const StreamFormat&, StreamBuffer& info,
-    const char*& source, bool)
+    const char*& source, bool scanFormat)
 {
     unsigned int n;
     char* c;
+    TimestampFormat* tf = NULL;
 
+    info.append(&tf, sizeof(tf)); // put compiled format here later
     if (*source == '(')
     {
         while (*++source != ')')
@@ -144,40 +425,146 @@ parse(const StreamFormat&, StreamBuffer& info,
     {
         info.append("%Y-%m-%d %H:%M:%S").append('\0');
     }
+    const char* format = info(sizeof(tf));
+    tf = new TimestampFormat(scanFormat ? compileScan(format) : compilePrint(format));
+    memcpy(info(0), &tf, sizeof(tf));
     return double_format;
 }
 
+void TimestampConverter::
+release(const StreamFormat& format)
+{
+    const char* info = format.info;
+    delete extract<TimestampFormat*>(info);
+}
+
+template<class T>
+static void printNumber(StreamBuffer& output, T value, size_t width, char pad)
+{
+    char buffer[24];
+    size_t i = sizeof(buffer);
+    bool negative = value < 0;
+
+    do {
+        int digit = (int)(value % 10);
+        buffer[--i] = '0' + (digit < 0 ? -digit : digit);
+        value /= 10;
+    } while (value);
+    while (sizeof(buffer) - i < width) buffer[--i] = pad;
+    if (negative) buffer[--i] = '-';
+    output.append(buffer + i, sizeof(buffer) - i);
+}
+
+/* the digits printf("%.*f") prints after the decimal point */
+static void printFraction(StreamBuffer& output, double frac, long digits)
+{
+    static const double scale[] = {
+        1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    char buffer[64];
+
+    if (digits <= 0) return;
+    if (frac < 0) frac = -frac;
+    if (digits <= 9)
+    {
+        double x = frac * scale[digits];
+        double i = floor(x);
+        double r = x - i;
+        /* rounding of halves differs between printf implementations */
+        if (fabs(r - 0.5) > 1e-6)
+        {
+            unsigned long value = (unsigned long)i + (r > 0.5);
+            if (value >= scale[digits]) value = 0; /* 0.9999 -> "000" */
+            printNumber(output, value, digits, '0');
+            return;
+        }
+    }
+    if (digits > 40) digits = 40;
+    sprintf(buffer, "%.*f", (int)digits, frac);
+    output.append(strchr(buffer, '.') + 1);
+}
+
 bool TimestampConverter::
 printDouble(const StreamFormat& format, StreamBuffer& output, double value)
 {
-    struct tm brokenDownTime;
-    char buffer [40];
-    char fracbuffer [15];
+    const char* info = format.info;
+    TimestampFormat* tf = extract<TimestampFormat*>(info);
+    const struct tm& brokenDownTime = tf->printTime;
+    char buffer [100];
     size_t length;
     time_t sec;
     double frac;
-    ssize_t i;
-    size_t n;
-    char* c;
-    char* p;
+    long offset;
 
     sec = (time_t) value;
     frac = value - sec;
-    localtime_r(&sec, &brokenDownTime);
-    debug ("TimestampConverter::printDouble %f, '%s'\n", value, format.info);
-    length = strftime(buffer, sizeof(buffer), format.info, &brokenDownTime);
-    i = output.length();
-    output.append(buffer, length);
-
-    /* look for fractional seconds */
-    while ((i = output.find("%0",i)) != -1)
+    debug ("TimestampConverter::printDouble %f, '%s'\n", value, info);
+    if (!tf->printValid || sec != tf->printSecond)
+    {
+        localtime_r(&sec, &tf->printTime);
+        tf->utcOffset = (long)(civilSeconds(tf->printTime) - sec);
+        tf->printSecond = sec;
+        tf->printValid = true;
+    }
+    for (const TimestampOp* op = tf->ops; op; op = op->next)
     {
-        n = strtol(output(i+1), &c, 10);
-        if (*c++ != 'f') return false;
-        /* print fractional part */
-        sprintf(fracbuffer, "%.*f", (int)n, frac);
-        p = strchr(fracbuffer, '.')+1;
-        output.replace(i, c-output(i), p);
+        switch (op->code)
+        {
+            case opLiteral:
+                output.append(op->text);
+                break;
+            case opStrftime:
+                length = strftime(buffer, sizeof(buffer), op->text(), &brokenDownTime);
+                output.append(buffer, length);
+                break;
+            case opFraction:
+                printFraction(output, frac, op->value);
+                break;
+            case 'Y':
+                printNumber(output, brokenDownTime.tm_year + 1900, 1, '0');
+                break;
+            case 'y':
+                printNumber(output, (brokenDownTime.tm_year % 100 + 100) % 100, 2, '0');
+                break;
+            case 'm':
+                printNumber(output, brokenDownTime.tm_mon + 1, 2, '0');
+                break;
+            case 'd':
+                printNumber(output, brokenDownTime.tm_mday, 2, '0');
+                break;
+            case 'e':
+                printNumber(output, brokenDownTime.tm_mday, 2, ' ');
+                break;
+            case 'j':
+                printNumber(output, brokenDownTime.tm_yday + 1, 3, '0');
+                break;
+            case 'H':
+                printNumber(output, brokenDownTime.tm_hour, 2, '0');
+                break;
+            case 'k':
+                printNumber(output, brokenDownTime.tm_hour, 2, ' ');
+                break;
+            case 'I':
+                printNumber(output, (brokenDownTime.tm_hour + 11) % 12 + 1, 2, '0');
+                break;
+            case 'l':
+                printNumber(output, (brokenDownTime.tm_hour + 11) % 12 + 1, 2, ' ');
+                break;
+            case 'M':
+                printNumber(output, brokenDownTime.tm_min, 2, '0');
+                break;
+            case 'S':
+                printNumber(output, brokenDownTime.tm_sec, 2, '0');
+                break;
+            case 's':
+                printNumber(output, sec, 1, '0');
+                break;
+            case 'z':
+                offset = tf->utcOffset / 60;
+                output.append(offset < 0 ? '-' : '+');
+                if (offset < 0) offset = -offset;
+                printNumber(output, offset / 60 * 100 + offset % 60, 4, '0');
+                break;
+        }
     }
     return true;
 }
@@ -222,7 +609,8 @@ static int nummatch(const char*& input, int min, int max)
     return i;
 }
 
-static const char* scantime(const char* input, const char* format, struct tm *tm, unsigned long *ns)
+
+static const char* scantime(const char* input, const TimestampOp* op, struct tm *tm, unsigned long *ns, long nativeZone)
 {
     static const char* months[] = {
         "january", "february", "march", "april", "may", "june",
@@ -234,273 +622,231 @@ static const char* scantime(const char* input, const char* format, struct tm *tm
     int pm = -1;
     int century = -1;
     int zone = 0;
+    const char* c;
 
-    tzset();
-    zone = timezone/60;
+    zone = nativeZone/60;
     debug ("TimestampConverter::scantime: native time zone = %d\n", zone);
 
-    while (*format)
+    for (; op; op = op->next)
     {
-        switch (*format)
+        if (isalpha(op->code))
+            debug ("TimestampConverter::scantime: input = '%s'\n", input);
+        switch (op->code)
         {
-            case '%':
-                debug ("TimestampConverter::scantime: input = '%s'\n", input);
-                format++;
-startover:
-                switch (*format++)
+            case opLiteral:
+                for (c = op->text(); *c; c++)
                 {
-                /* Modifiers (ignore) */
-                    case 'E':
-                    case 'O':
-                        goto startover;
-                /* constants */
-                    case 0: /* stray % at end of format string */
-                        format--;
-                    case '%':
-                        if (*input++ != '%') return NULL;
-                        break;
-                    case 'n':
-                        if (*input++ != '\n') return NULL;
-                        break;
-                    case 't':
-                        if (*input++ != '\t') return NULL;
-                        break;
-                /* ignored */
-                    case 'A': /* day of week name */
-                    case 'a':
-                        while (isalpha((int)*input)) input++;
-                        /* ignore */
-                        break;
-                    case 'u': /* day of week number (Monday = 1 to Sunday = 7) */
-                    case 'w': /* day of week number (Sunday = 0 to Saturday = 6) */
-                        i = nummatch(input, 0, 7);
-                        if (i < 0)
-                        {
-                            error ("error parsing day of week: '%.20s'\n", input);
-                            return NULL;
-                        }
-                        debug ("TimestampConverter::scantime: day of week = %d\n", i);
-                        /* ignore */
-                        break;
-                    case 'U': /* week number */
-                    case 'W':
-                    case 'V':
-                        i = nummatch(input, 0, 53);
-                        if (i < 0)
-                        {
-                            error ("error parsing week number: '%.20s'\n", input);
-                            return NULL;
-                        }
-                        debug ("TimestampConverter::scantime: week number = %d\n", i);
-                        /* ignore */
-                        break;
-                    case 'j': /* day of year */
-                        i = nummatch(input, 0, 366);
-                        if (i < 0)
-                        {
-                            error ("error parsing day of year: '%.20s'\n", input);
-                            return NULL;
-                        }
-                        debug ("TimestampConverter::scantime: day of year = %d\n", i);
-                        /* ignore */
-                        break;
-                    case 'Z': /* time zone name */
-                        while (isalpha((int)*input)) input++;
-                        /* ignore */
-                        break;
-                /* date */
-                    case 'b': /* month */
-                    case 'h':
-                    case 'B':
-                    case 'm':
-                        i = strmatch(input, months, 3);
-                        if (i < 0)
-                        {
-                            i = nummatch(input, 1, 12);
-                            if (i < 0)
-                            {
-                                error ("error parsing month: '%.20s'\n", input);
-                                return NULL;
-                            }
-                            i--;  /* Jan = 0 */
-                        }
-                        tm->tm_mon = i;
-                        debug ("TimestampConverter::scantime: month = %d (%s)\n", tm->tm_mon+1, months[tm->tm_mon]);
-                        break;
-                    case 'd': /* day of month */
-                    case 'e':
-                        i = nummatch(input, 1, 31);
-                        if (i < 0)
-                        {
-                            error ("error parsing day of month: '%.20s'\n", input);
-                            return NULL;
-                        }
-                        tm->tm_mday = i;
-                        debug ("TimestampConverter::scantime: day = %d\n", tm->tm_mday);
-                        break;
-                    case 'Y': /* year */
-                    case 'y':
-                        i = strtol(input, (char**)&input, 10);
-                        if (i < 100)
-                        { /* 2 digit year */
-                            if (century == -1) century = (i >= 69);
-                            tm->tm_year = i + century * 100; /* 0 = 1900 */
-                        }
-                        else
-                        { /* 4 digit year */
-                            tm->tm_year = i - 1900; /* 0 = 1900 */
-                        }
-                        debug ("TimestampConverter::scantime: year = %d\n", tm->tm_year + 1900);
-                        break;
-                    case 'C': /* century */
-                        i = nummatch(input, 0, 99);
-                        if (i < 0)
-                        {
-                            error ("error parsing century: '%.20s'\n", input);
-                            return NULL;
-                        }
-                        century = i - 19;
-                        tm->tm_year = tm->tm_year%100 + 100 * i; /* 0 = 1900 */
-                        debug ("TimestampConverter::scantime: year = %d\n", tm->tm_year + 1900);
-                        break;
-
-                /* time */
-                    case 'H': /* hour */
-                    case 'k':
-                    case 'I':
-                    case 'l':
-                        i = nummatch(input, 0, 23);
-                        if (i < 0)
-                        {
-                            error ("error parsing hour: '%.20s'\n", input);
-                            return NULL;
-                        }
-                        if ((pm == 0) && (i == 12)) i = 0;
-                        if ((pm == 1) && (i < 12)) i += 12;
-                        tm->tm_hour = i;
-                        debug ("TimestampConverter::scantime: hour = %d\n", tm->tm_hour);
-                        break;
-                    case 'P': /* AM / PM */
-                    case 'p':
-                        i = strmatch(input, ampm, 1);
-                        if (i < 0)
-                        {
-                            error ("error parsing am/pm: '%.20s'\n", input);
-                            return NULL;
-                        }
-                        pm = i;
-                        if ((pm == 0) && (tm->tm_hour == 12)) tm->tm_hour = 0;
-                        if ((pm == 1) && (tm->tm_hour < 12)) tm->tm_hour += 12;
-                        debug ("TimestampConverter::scantime: %s hour = %d\n", pm?"PM":"AM", tm->tm_hour);
-                        break;
-                    case 'M': /* minute */
-                        i = nummatch(input, 0, 59);
-                        if (i < 0)
-                        {
-                            error ("error parsing minute: '%.20s'\n", input);
-                            return NULL;
-                        }
-                        tm->tm_min = i;
-                        debug ("TimestampConverter::scantime: min = %d\n", tm->tm_min);
-                        break;
-                    case 'S': /* second */
-                        i = nummatch(input, 0, 60);
-                        if (i < 0)
-                        {
-                            error ("error parsing week second: '%.20s'\n", input);
-                            return NULL;
-                        }
-                        tm->tm_sec = i;
-                        debug ("TimestampConverter::scantime: sec = %d\n", tm->tm_sec);
-                        break;
-                    case 's': /* second since 1970 */
-                        i = strtol(input, (char**)&input, 10);
-                        tm->tm_sec = i;
-                        tm->tm_mon = -1;
-                        tm->tm_isdst = 0;
-                        debug ("TimestampConverter::scantime: sec = %d\n", tm->tm_sec);
-                        break;
-                    case '0': /* fractions of seconds like %09f */
-                        n = strtol(format-1, (char**)&format, 10);
-                        if (*format++ != 'f') return NULL;
-                        debug ("max %d digits fraction in '%s'\n", n, input);
-                        i = 0;
-                        while (n-- && isdigit(*input))
-                        {
-                            i *= 10;
-                            i += *input++ - '0';
-                        }
-                        while (i < 100000000) i *= 10;
-                        *ns = i;
-                        debug ("TimestampConverter::scantime: nanosec = %d, rest '%s'\n", i, input);
-                        break;
-                    case 'z': /* time zone offset */
-                        i = nummatch(input, -2400, 2400);
-                        if (i < -2400)
-                        {
-                            error ("error parsing time zone: '%.20s'\n", input);
-                            return NULL;
-                        }
-                        zone = i / 100 * 60 + i % 100;
-                        tm->tm_isdst = 0;
-                        debug ("TimestampConverter::scantime: zone = %d\n", zone);
-                        break;
-                    case '+': /* set time zone in format string */
-                    case '-':
-                        format--;
-                        i = nummatch(format, -2400, 2400);
-                        zone = i / 100 * 60 + i % 100;
-                        tm->tm_isdst = 0;
-                        debug ("TimestampConverter::scantime: zone = %d\n", zone);
-                        break;
-                /* shortcuts */
-                    case 'c':
-                        if ((input = scantime(input, "%a %b %d %H:%M:%S %Y", tm, ns)) == NULL)
-                            return NULL;
-                        break;
-                    case 'D':
-                        if ((input = scantime(input, "%m/%d/%y", tm, ns)) == NULL)
-                            return NULL;
-                        break;
-                    case 'F':
-                        if ((input = scantime(input, "%Y-%m-%d", tm, ns)) == NULL)
-                            return NULL;
-                        break;
-                    case 'R':
-                        if ((input = scantime(input, "%H:%M", tm, ns)) == NULL)
-                            return NULL;
-                        break;
-                    case 'T':
-                        if ((input = scantime(input, "%H:%M:%S", tm, ns)) == NULL)
-                            return NULL;
-                        break;
-                    case 'x':
-                        if ((input = scantime(input, "%m/%d/%y", tm, ns)) == NULL)
-                            return NULL;
-                        break;
-                    case 'X':
-                    case 'r':
-                        if ((input = scantime(input, "%I:%M:%S %p", tm, ns)) == NULL)
-                            return NULL;
-                        break;
-                    default:
-                        error ("unknown time format %%%s\n", --format);
+                    if (*c != *input++)
+                    {
+                        error("input '%.20s' does not match constant '%.20s'\n", --input, c);
                         return NULL;
+                    }
                 }
                 break;
-            case ' ':
-                format++;
+            case opSpace:
                 while (isspace(*input)) input++;
                 break;
-            default:
-                if (*format++ != *input++)
+        /* constants */
+            case opConstant:
+                if (*input++ != op->value) return NULL;
+                break;
+            case opFail:
+                return NULL;
+            case opUnknown:
+                error ("unknown time format %%%s\n", op->text());
+                return NULL;
+        /* ignored */
+            case 'A': /* day of week name */
+            case 'a':
+                while (isalpha((int)*input)) input++;
+                /* ignore */
+                break;
+            case 'u': /* day of week number (Monday = 1 to Sunday = 7) */
+            case 'w': /* day of week number (Sunday = 0 to Saturday = 6) */
+                i = nummatch(input, 0, 7);
+                if (i < 0)
+                {
+                    error ("error parsing day of week: '%.20s'\n", input);
+                    return NULL;
+                }
+                debug ("TimestampConverter::scantime: day of week = %d\n", i);
+                /* ignore */
+                break;
+            case 'U': /* week number */
+            case 'W':
+            case 'V':
+                i = nummatch(input, 0, 53);
+                if (i < 0)
+                {
+                    error ("error parsing week number: '%.20s'\n", input);
+                    return NULL;
+                }
+                debug ("TimestampConverter::scantime: week number = %d\n", i);
+                /* ignore */
+                break;
+            case 'j': /* day of year */
+                i = nummatch(input, 0, 366);
+                if (i < 0)
+                {
+                    error ("error parsing day of year: '%.20s'\n", input);
+                    return NULL;
+                }
+                debug ("TimestampConverter::scantime: day of year = %d\n", i);
+                /* ignore */
+                break;
+            case 'Z': /* time zone name */
+                while (isalpha((int)*input)) input++;
+                /* ignore */
+                break;
+        /* date */
+            case 'b': /* month */
+            case 'h':
+            case 'B':
+            case 'm':
+                i = strmatch(input, months, 3);
+                if (i < 0)
+                {
+                    i = nummatch(input, 1, 12);
+                    if (i < 0)
+                    {
+                        error ("error parsing month: '%.20s'\n", input);
+                        return NULL;
+                    }
+                    i--;  /* Jan = 0 */
+                }
+                tm->tm_mon = i;
+                debug ("TimestampConverter::scantime: month = %d (%s)\n", tm->tm_mon+1, months[tm->tm_mon]);
+                break;
+            case 'd': /* day of month */
+            case 'e':
+                i = nummatch(input, 1, 31);
+                if (i < 0)
+                {
+                    error ("error parsing day of month: '%.20s'\n", input);
+                    return NULL;
+                }
+                tm->tm_mday = i;
+                debug ("TimestampConverter::scantime: day = %d\n", tm->tm_mday);
+                break;
+            case 'Y': /* year */
+            case 'y':
+                i = strtol(input, (char**)&input, 10);
+                if (i < 100)
+                { /* 2 digit year */
+                    if (century == -1) century = (i >= 69);
+                    tm->tm_year = i + century * 100; /* 0 = 1900 */
+                }
+                else
+                { /* 4 digit year */
+                    tm->tm_year = i - 1900; /* 0 = 1900 */
+                }
+                debug ("TimestampConverter::scantime: year = %d\n", tm->tm_year + 1900);
+                break;
+            case 'C': /* century */
+                i = nummatch(input, 0, 99);
+                if (i < 0)
                 {
-                    error("input '%.20s' does not match constant '%.20s'\n", --input, --format);
+                    error ("error parsing century: '%.20s'\n", input);
                     return NULL;
                 }
+                century = i - 19;
+                tm->tm_year = tm->tm_year%100 + 100 * i; /* 0 = 1900 */
+                debug ("TimestampConverter::scantime: year = %d\n", tm->tm_year + 1900);
+                break;
+
+        /* time */
+            case 'H': /* hour */
+            case 'k':
+            case 'I':
+            case 'l':
+                i = nummatch(input, 0, 23);
+                if (i < 0)
+                {
+                    error ("error parsing hour: '%.20s'\n", input);
+                    return NULL;
+                }
+                if ((pm == 0) && (i == 12)) i = 0;
+                if ((pm == 1) && (i < 12)) i += 12;
+                tm->tm_hour = i;
+                debug ("TimestampConverter::scantime: hour = %d\n", tm->tm_hour);
+                break;
+            case 'P': /* AM / PM */
+            case 'p':
+                i = strmatch(input, ampm, 1);
+                if (i < 0)
+                {
+                    error ("error parsing am/pm: '%.20s'\n", input);
+                    return NULL;
+                }
+                pm = i;
+                if ((pm == 0) && (tm->tm_hour == 12)) tm->tm_hour = 0;
+                if ((pm == 1) && (tm->tm_hour < 12)) tm->tm_hour += 12;
+                debug ("TimestampConverter::scantime: %s hour = %d\n", pm?"PM":"AM", tm->tm_hour);
+                break;
+            case 'M': /* minute */
+                i = nummatch(input, 0, 59);
+                if (i < 0)
+                {
+                    error ("error parsing minute: '%.20s'\n", input);
+                    return NULL;
+                }
+                tm->tm_min = i;
+                debug ("TimestampConverter::scantime: min = %d\n", tm->tm_min);
+                break;
+            case 'S': /* second */
+                i = nummatch(input, 0, 60);
+                if (i < 0)
+                {
+                    error ("error parsing week second: '%.20s'\n", input);
+                    return NULL;
+                }
+                tm->tm_sec = i;
+                debug ("TimestampConverter::scantime: sec = %d\n", tm->tm_sec);
+                break;
+            case 's': /* second since 1970 */
+                i = strtol(input, (char**)&input, 10);
+                tm->tm_sec = i;
+                tm->tm_mon = -1;
+                tm->tm_isdst = 0;
+                debug ("TimestampConverter::scantime: sec = %d\n", tm->tm_sec);
+                break;
+            case opFraction: /* fractions of seconds like %09f */
+                n = op->value;
+                debug ("max %d digits fraction in '%s'\n", n, input);
+                i = 0;
+                while (n-- && isdigit(*input))
+                {
+                    i *= 10;
+                    i += *input++ - '0';
+                }
+                while (i < 100000000) i *= 10;
+                *ns = i;
+                debug ("TimestampConverter::scantime: nanosec = %d, rest '%s'\n", i, input);
+                break;
+            case 'z': /* time zone offset */
+                i = nummatch(input, -2400, 2400);
+                if (i < -2400)
+                {
+                    error ("error parsing time zone: '%.20s'\n", input);
+                    return NULL;
+                }
+                zone = i / 100 * 60 + i % 100;
+                tm->tm_isdst = 0;
+                debug ("TimestampConverter::scantime: zone = %d\n", zone);
+                break;
+            case opZone: /* time zone set in format string */
+                i = op->value;
+                zone = i / 100 * 60 + i % 100;
+                tm->tm_isdst = 0;
+                debug ("TimestampConverter::scantime: zone = %d\n", zone);
+                break;
+        /* shortcuts like %T */
+            default:
+                if ((input = scantime(input, op->sub, tm, ns, nativeZone)) == NULL)
+                    return NULL;
         }
     }
-    zone -= timezone/60;
+    zone -= nativeZone/60;
     tm->tm_min += zone;
     tm->tm_hour += tm->tm_min / 60;
     tm->tm_min %= 60;
@@ -522,14 +868,27 @@ startover:
 ssize_t TimestampConverter::
 scanDouble(const StreamFormat& format, const char* input, double& value)
 {
+    const char* info = format.info;
+    TimestampFormat* tf = extract<TimestampFormat*>(info);
     struct tm brokenDownTime;
     time_t seconds;
     unsigned long nanoseconds;
     const char* end;
 
-    /* Init time stamp with "today" */
     time (&seconds);
-    localtime_r(&seconds, &brokenDownTime);
+    if (!tf->nowValid || seconds != tf->now)
+    {
+        /* refresh time zone and "today" once per second */
+        tzset();
+        tf->zone = timezone;
+        localtime_r(&seconds, &tf->today);
+        tf->now = seconds;
+        tf->nowValid = true;
+        tf->mktimeValid = false;
+    }
+
+    /* Init time stamp with "today" */
+    brokenDownTime = tf->today;
     brokenDownTime.tm_sec = 0;
     brokenDownTime.tm_min = 0;
     brokenDownTime.tm_hour = 0;
@@ -537,14 +896,24 @@ scanDouble(const StreamFormat& format, const char* input, double& value)
     brokenDownTime.tm_isdst = -1;
     nanoseconds = 0;
 
-    end = scantime(input, format.info, &brokenDownTime, &nanoseconds);
+    end = scantime(input, tf->ops, &brokenDownTime, &nanoseconds, tf->zone);
     if (end == NULL) {
         error ("error parsing time\n");
         return -1;
     }
     if (brokenDownTime.tm_mon == -1) {
         seconds = brokenDownTime.tm_sec;
+    } else if (tf->mktimeValid && brokenDownTime.tm_sec >= 0 && brokenDownTime.tm_sec < 60
+        && brokenDownTime.tm_min == tf->mktimeKey.tm_min
+        && brokenDownTime.tm_hour == tf->mktimeKey.tm_hour
+        && brokenDownTime.tm_mday == tf->mktimeKey.tm_mday
+        && brokenDownTime.tm_mon == tf->mktimeKey.tm_mon
+        && brokenDownTime.tm_year == tf->mktimeKey.tm_year
+        && brokenDownTime.tm_isdst == tf->mktimeKey.tm_isdst) {
+        /* same minute as before, no time zone change possible */
+        seconds = tf->mktimeBase + brokenDownTime.tm_sec;
     } else {
+        struct tm key = brokenDownTime;
         seconds = mktime(&brokenDownTime);
         if (seconds == (time_t) -1 && brokenDownTime.tm_yday == 0)
         {
@@ -557,6 +926,12 @@ scanDouble(const StreamFormat& format, const char* input, double& value)
                 brokenDownTime.tm_sec);
             return -1;
         }
+        if (key.tm_sec >= 0 && key.tm_sec < 60)
+        {
+            tf->mktimeKey = key;
+            tf->mktimeBase = seconds - key.tm_sec;
+            tf->mktimeValid = true;
+        }
     }
     value = seconds + nanoseconds*1e-9;
     return end-input;
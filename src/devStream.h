@@ -112,6 +112,10 @@ long streamGetIointInfo(int cmd,
 long streamPrintf(dbCommon *record, format_t *format, ...);
 ssize_t streamScanfN(dbCommon *record, format_t *format,
     void*, size_t maxStringSize);
+long streamPrintArray(dbCommon *record, format_t *format,
+    const void* values, int dbfType, size_t count);
+ssize_t streamScanArray(dbCommon *record, format_t *format,
+    void* values, int dbfType, size_t maxElements);
 
 #ifdef __cplusplus
 }
@@ -29,6 +29,29 @@ static long readData(dbCommon *record, format_t *format)
     double dval;
     long lval;
 
+    /* numeric arrays: convert all elements at once */
+    if (format->type != DBF_STRING && (format->type != DBF_DOUBLE
+        || aai->ftvl == DBF_DOUBLE || aai->ftvl == DBF_FLOAT))
+    {
+        switch (aai->ftvl)
+        {
+            case DBF_DOUBLE:
+            case DBF_FLOAT:
+            case DBF_LONG:
+            case DBF_ULONG:
+            case DBF_SHORT:
+            case DBF_USHORT:
+            case DBF_ENUM:
+            case DBF_CHAR:
+            case DBF_UCHAR:
+            {
+                ssize_t count = streamScanArray(record, format,
+                    aai->bptr, aai->ftvl, aai->nelm);
+                aai->nord = count == ERROR ? 0 : (long)count;
+                return aai->nord ? OK : ERROR;
+            }
+        }
+    }
     for (aai->nord = 0; aai->nord < aai->nelm; aai->nord++)
     {
         switch (format->type)
@@ -155,6 +178,25 @@ static long writeData(dbCommon *record, format_t *format)
     long lval;
     unsigned long nowd;
 
+    /* numeric arrays: convert all elements at once */
+    if (format->type != DBF_STRING && (format->type == DBF_DOUBLE
+        || (aai->ftvl != DBF_DOUBLE && aai->ftvl != DBF_FLOAT)))
+    {
+        switch (aai->ftvl)
+        {
+            case DBF_DOUBLE:
+            case DBF_FLOAT:
+            case DBF_LONG:
+            case DBF_ULONG:
+            case DBF_SHORT:
+            case DBF_USHORT:
+            case DBF_ENUM:
+            case DBF_CHAR:
+            case DBF_UCHAR:
+                return streamPrintArray(record, format,
+                    aai->bptr, aai->ftvl, aai->nord);
+        }
+    }
     for (nowd = 0; nowd < aai->nord; nowd++)
     {
         switch (format->type)
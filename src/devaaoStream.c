@@ -31,6 +31,29 @@ static long readData(dbCommon *record, format_t *format)
     long lval;
     unsigned short monitor_mask;
 
+    /* numeric arrays: convert all elements at once */
+    if (format->type != DBF_STRING && (format->type != DBF_DOUBLE
+        || aao->ftvl == DBF_DOUBLE || aao->ftvl == DBF_FLOAT))
+    {
+        switch (aao->ftvl)
+        {
+            case DBF_DOUBLE:
+            case DBF_FLOAT:
+            case DBF_LONG:
+            case DBF_ULONG:
+            case DBF_SHORT:
+            case DBF_USHORT:
+            case DBF_ENUM:
+            case DBF_CHAR:
+            case DBF_UCHAR:
+            {
+                ssize_t count = streamScanArray(record, format,
+                    aao->bptr, aao->ftvl, aao->nelm);
+                aao->nord = count == ERROR ? 0 : (long)count;
+                goto end;
+            }
+        }
+    }
     for (aao->nord = 0; aao->nord < aao->nelm; aao->nord++)
     {
         switch (format->type)
@@ -183,6 +206,25 @@ static long writeData(dbCommon *record, format_t *format)
     long lval;
     unsigned long nowd;
 
+    /* numeric arrays: convert all elements at once */
+    if (format->type != DBF_STRING && (format->type == DBF_DOUBLE
+        || (aao->ftvl != DBF_DOUBLE && aao->ftvl != DBF_FLOAT)))
+    {
+        switch (aao->ftvl)
+        {
+            case DBF_DOUBLE:
+            case DBF_FLOAT:
+            case DBF_LONG:
+            case DBF_ULONG:
+            case DBF_SHORT:
+            case DBF_USHORT:
+            case DBF_ENUM:
+            case DBF_CHAR:
+            case DBF_UCHAR:
+                return streamPrintArray(record, format,
+                    aao->bptr, aao->ftvl, aao->nord);
+        }
+    }
     for (nowd = 0; nowd < aao->nord; nowd++)
     {
         switch (format->type)
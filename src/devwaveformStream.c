@@ -30,6 +30,29 @@ static long readData(dbCommon *record, format_t *format)
     long lval;
 
     wf->rarm = 0;
+    /* numeric arrays: convert all elements at once */
+    if (format->type != DBF_STRING && (format->type != DBF_DOUBLE
+        || wf->ftvl == DBF_DOUBLE || wf->ftvl == DBF_FLOAT))
+    {
+        switch (wf->ftvl)
+        {
+            case DBF_DOUBLE:
+            case DBF_FLOAT:
+            case DBF_LONG:
+            case DBF_ULONG:
+            case DBF_SHORT:
+            case DBF_USHORT:
+            case DBF_ENUM:
+            case DBF_CHAR:
+            case DBF_UCHAR:
+            {
+                ssize_t count = streamScanArray(record, format,
+                    wf->bptr, wf->ftvl, wf->nelm);
+                wf->nord = count == ERROR ? 0 : (long)count;
+                return wf->nord ? OK : ERROR;
+            }
+        }
+    }
     for (wf->nord = 0; wf->nord < wf->nelm; wf->nord++)
     {
         switch (format->type)
@@ -156,6 +179,25 @@ static long writeData(dbCommon *record, format_t *format)
     long lval;
     unsigned long nowd;
 
+    /* numeric arrays: convert all elements at once */
+    if (format->type != DBF_STRING && (format->type == DBF_DOUBLE
+        || (wf->ftvl != DBF_DOUBLE && wf->ftvl != DBF_FLOAT)))
+    {
+        switch (wf->ftvl)
+        {
+            case DBF_DOUBLE:
+            case DBF_FLOAT:
+            case DBF_LONG:
+            case DBF_ULONG:
+            case DBF_SHORT:
+            case DBF_USHORT:
+            case DBF_ENUM:
+            case DBF_CHAR:
+            case DBF_UCHAR:
+                return streamPrintArray(record, format,
+                    wf->bptr, wf->ftvl, wf->nord);
+        }
+    }
     for (nowd = 0; nowd < wf->nord; nowd++)
     {
         switch (format->type)
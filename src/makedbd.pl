@@ -35,6 +35,8 @@ if (@ARGV[0] eq "-3.13") {
     print "variable(streamDebugColored, int)\n";
     print "variable(streamErrorDeadTime, int)\n";
     print "variable(streamMsgTimeStamped, int)\n";
+    print "variable(streamParallelInit, int)\n";
+    print "variable(streamCallbackThreads, int)\n";
     print "registrar(streamRegistrar)\n";
     if ($asyn) { print "registrar(AsynDriverInterfaceRegistrar)\n"; }
 }
@@ -0,0 +1,614 @@
+/*************************************************************************
+* This is a host tool to check and profile StreamDevice protocol files
+* without running an IOC.
+* Please see ../docs/ for detailed documentation.
+*
+* This file is part of StreamDevice.
+*
+* StreamDevice is free software: You can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published
+* by the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* StreamDevice is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with StreamDevice. If not, see https://www.gnu.org/licenses/.
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "epicsThread.h"
+
+#include "StreamCore.h"
+#include "StreamError.h"
+
+#define Z PRINTF_SIZE_T_PREFIX
+
+// Recorded input for the check bus.
+// One line of the input file is one message from the device.
+// Escape sequences \r \n \t \\ \xHH and \0 are decoded.
+
+static StreamBuffer inputMessages;  // messages, each terminated by \0
+static size_t inputCount;           // number of messages
+static size_t inputPosition;        // next message to read
+static size_t inputRead;            // messages read so far
+static size_t outputBytes;          // bytes written so far
+
+static bool readInputFile(const char* filename)
+{
+    FILE* file;
+    StreamBuffer line;
+    int c;
+
+    file = fopen(filename, "rb");
+    if (!file)
+    {
+        error("Can't open input file '%s'\n", filename);
+        return false;
+    }
+    inputMessages.clear();
+    inputCount = 0;
+    do {
+        c = getc(file);
+        if (c == '\r') continue;
+        if (c == EOF && !line) break;
+        if (c == '\n' || c == EOF)
+        {
+            inputMessages.print("%" Z "u", line.length()).append('\0');
+            inputMessages.append(line);
+            inputCount++;
+            line.clear();
+            continue;
+        }
+        if (c == '\\')
+        {
+            c = getc(file);
+            switch (c)
+            {
+                case 'r': c = '\r'; break;
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case '0': c = '\0'; break;
+                case 'x':
+                {
+                    char hex[3] = {0};
+                    hex[0] = (char)getc(file);
+                    hex[1] = (char)getc(file);
+                    c = (int)strtoul(hex, NULL, 16);
+                    break;
+                }
+                case EOF: c = '\\';
+            }
+        }
+        line.append((char)c);
+    } while (c != EOF);
+    fclose(file);
+    return true;
+}
+
+// The check bus interface is non-blocking like the DebugInterface:
+// All callbacks are called immediately.
+// Writes are only counted, reads deliver the recorded input.
+
+class CheckInterface : StreamBusInterface
+{
+    CheckInterface(Client* client) : StreamBusInterface(client) {}
+
+    // StreamBusInterface methods
+    bool lockRequest(unsigned long lockTimeout_ms);
+    bool unlock();
+    bool writeRequest(const void* output, size_t size,
+        unsigned long writeTimeout_ms);
+    bool readRequest(unsigned long replyTimeout_ms,
+        unsigned long readTimeout_ms, ssize_t expectedLength, bool async);
+
+public:
+    // static creator method
+    static StreamBusInterface* getBusInterface(Client* client,
+        const char* busname, int addr, const char* param);
+};
+
+RegisterStreamBusInterface(CheckInterface);
+
+StreamBusInterface* CheckInterface::
+getBusInterface(Client* client, const char* busname, int, const char*)
+{
+    if (strcmp(busname, "check") == 0)
+        return new CheckInterface(client);
+    return NULL;
+}
+
+bool CheckInterface::
+lockRequest(unsigned long)
+{
+    lockCallback(StreamIoSuccess);
+    return true;
+}
+
+bool CheckInterface::
+unlock()
+{
+    return true;
+}
+
+bool CheckInterface::
+writeRequest(const void* output, size_t size, unsigned long)
+{
+    debug("CheckInterface::writeRequest(%s, \"%s\")\n",
+        clientName(), StreamBuffer(output, size).expand()());
+    outputBytes += size;
+    writeCallback(StreamIoSuccess);
+    return true;
+}
+
+bool CheckInterface::
+readRequest(unsigned long, unsigned long, ssize_t, bool async)
+{
+    const char* message;
+    size_t size;
+
+    if (async) return false;
+    if (inputRead >= inputCount)
+    {
+        readCallback(StreamIoNoReply);
+        return true;
+    }
+    message = inputMessages(inputPosition);
+    size = strtoul(message, (char**)&message, 10);
+    message++;
+    inputPosition = message + size - inputMessages();
+    inputRead++;
+    readCallback(StreamIoEnd, message, size);
+    return true;
+}
+
+// A stream without a record.
+// Values are kept in the StreamCheck object.
+// With elements > 1 it behaves like an array record
+// and numeric values are converted with printArray() and scanArray().
+// Redirections %(field) use the same values.
+
+class StreamCheck : StreamCore
+{
+    long longValue;
+    double doubleValue;
+    char stringValue[40];
+    int* longArray;
+    double* doubleArray;
+    bool timerPending;
+
+    // StreamCore methods
+    void protocolFinishHook(ProtocolResult);
+    void startTimer(unsigned long timeout);
+    bool getFieldAddress(const char* fieldname, StreamBuffer& address);
+    bool formatValue(const StreamFormat&, const void* fieldaddress);
+    bool matchValue(const StreamFormat&, const void* fieldaddress);
+    void lockMutex() {}
+    void releaseMutex() {}
+    static size_t handlerSize(const Handler* handler)
+        { return handler ? handler->code.length() : 0; }
+
+    size_t elements;
+
+public:
+    bool finished;
+    ProtocolResult result;
+    unsigned long results[Offline+1];
+
+    StreamCheck(const char* name, const char* value);
+    ~StreamCheck();
+    void setElements(size_t n);
+    bool parse(const char* filename, const char* protocolname)
+        { return StreamCore::parse(filename, protocolname); }
+    bool attach(const char* busname)
+        { return attachBus(busname, -1, ""); }
+    bool run();
+    size_t compiledSize();
+    StreamBuffer handlerNames();
+    void printStatistics(FILE* file, double seconds);
+    void printProtocol(FILE* file) { StreamCore::printProtocol(file); }
+    void printStatus(StreamBuffer& buffer) { StreamCore::printStatus(buffer); }
+    static const char* resultString(int result)
+        { return toStr((ProtocolResult)result); }
+};
+
+StreamCheck::
+StreamCheck(const char* name, const char* value) :
+    longValue(0), doubleValue(0.0),
+    longArray(NULL), doubleArray(NULL), timerPending(false),
+    elements(1), finished(false), result(Success)
+{
+    // name must live longer than the stream, like record->name
+    streamname = const_cast<char*>(name);
+    memset(results, 0, sizeof(results));
+    memset(stringValue, 0, sizeof(stringValue));
+    if (value)
+    {
+        longValue = strtol(value, NULL, 0);
+        doubleValue = strtod(value, NULL);
+        strncpy(stringValue, value, sizeof(stringValue)-1);
+    }
+    attachBus("check", 0, NULL);
+}
+
+StreamCheck::
+~StreamCheck()
+{
+    delete[] longArray;
+    delete[] doubleArray;
+}
+
+void StreamCheck::
+setElements(size_t n)
+{
+    size_t i;
+
+    elements = n;
+    delete[] longArray;
+    delete[] doubleArray;
+    longArray = NULL;
+    doubleArray = NULL;
+    if (n <= 1) return;
+    longArray = new int[n];
+    doubleArray = new double[n];
+    for (i = 0; i < n; i++)
+    {
+        longArray[i] = (int)longValue;
+        doubleArray[i] = doubleValue;
+    }
+}
+
+size_t StreamCheck::
+compiledSize()
+{
+    return commands.length() + handlerSize(onInit) +
+        handlerSize(onWriteTimeout) + handlerSize(onReplyTimeout) +
+        handlerSize(onReadTimeout) + handlerSize(onMismatch) +
+        inTerminator.length() + outTerminator.length() +
+        separator.length();
+}
+
+StreamBuffer StreamCheck::
+handlerNames()
+{
+    StreamBuffer names;
+    if (onInit) names.append(" @init");
+    if (onMismatch) names.append(" @mismatch");
+    if (onWriteTimeout) names.append(" @writetimeout");
+    if (onReplyTimeout) names.append(" @replytimeout");
+    if (onReadTimeout) names.append(" @readtimeout");
+    if (!names) names.append(" -");
+    return names.remove(1);
+}
+
+void StreamCheck::
+protocolFinishHook(ProtocolResult status)
+{
+    result = status;
+    results[status]++;
+    finished = true;
+}
+
+void StreamCheck::
+startTimer(unsigned long)
+{
+    // time runs infinitely fast here
+    timerPending = true;
+}
+
+bool StreamCheck::
+getFieldAddress(const char* fieldname, StreamBuffer& address)
+{
+    // There are no fields, but accept any redirection.
+    // Redirected values use the same storage as the stream itself.
+    address.append(fieldname).append('\0');
+    return true;
+}
+
+bool StreamCheck::
+formatValue(const StreamFormat& format, const void*)
+{
+    size_t n;
+
+    if (elements > 1 && format.type == double_format)
+        return printArray(format, doubleArray, float64_array, elements);
+    if (elements > 1 && format.type != string_format)
+        return printArray(format, longArray, int32_array, elements);
+    for (n = 0; n < elements; n++)
+    {
+        switch (format.type)
+        {
+            case unsigned_format:
+            case signed_format:
+            case enum_format:
+                if (!printValue(format, longValue)) return false;
+                break;
+            case double_format:
+                if (!printValue(format, doubleValue)) return false;
+                break;
+            case string_format:
+                if (!printValue(format, stringValue)) return false;
+                break;
+            default:
+                error("INTERNAL ERROR: StreamCheck::formatValue %s: "
+                    "Illegal format type\n", name());
+                return false;
+        }
+    }
+    return true;
+}
+
+bool StreamCheck::
+matchValue(const StreamFormat& format, const void*)
+{
+    // this function must increase consumedInput
+    ssize_t consumed = 0;
+    size_t size;
+    size_t n;
+
+    if (elements > 1 && format.type != string_format)
+    {
+        n = elements;
+        if (format.type == double_format)
+            consumed = scanArray(format, doubleArray, float64_array, n);
+        else
+            consumed = scanArray(format, longArray, int32_array, n);
+        if (consumed < 0) return false;
+        consumedInput += consumed;
+        return true;
+    }
+    for (n = 0; n < elements; n++)
+    {
+        switch (format.type)
+        {
+            case unsigned_format:
+            case signed_format:
+            case enum_format:
+                consumed = scanValue(format, longValue);
+                break;
+            case double_format:
+                consumed = scanValue(format, doubleValue);
+                break;
+            case string_format:
+                size = sizeof(stringValue)-1;
+                consumed = scanValue(format, stringValue, size);
+                if (consumed >= 0) stringValue[size] = 0;
+                break;
+            default:
+                error("INTERNAL ERROR: StreamCheck::matchValue %s: "
+                    "Illegal format type\n", name());
+                return false;
+        }
+        if (consumed < 0) break;
+        consumedInput += consumed;
+    }
+    return n > 0;
+}
+
+// Run the protocol once.
+bool StreamCheck::
+run()
+{
+    finished = false;
+    if (!startProtocol(StartNormal)) return false;
+    while (!finished)
+    {
+        if (timerPending)
+        {
+            timerPending = false;
+            timerCallback();
+            continue;
+        }
+        if (!(flags & (BusPending|AcceptInput))) break;
+        // bus callback from another thread, e.g. timed replay
+        epicsThreadSleep(0.001);
+    }
+    if (!finished)
+    {
+        error("%s: Protocol did not finish\n", name());
+        return false;
+    }
+    return true;
+}
+
+void StreamCheck::
+printStatistics(FILE* file, double seconds)
+{
+    unsigned long runs = 0;
+    int i;
+
+    for (i = Success; i <= Offline; i++)
+    {
+        if (!results[i]) continue;
+        fprintf(file, "  %-14s %lu\n", resultString(i), results[i]);
+        runs += results[i];
+    }
+    fprintf(file, "  %-14s %lu\n", "runs", runs);
+    if (inputRead)
+    {
+        fprintf(file, "  %-14s %" Z "u\n", "input lines", inputRead);
+        fprintf(file, "  %-14s %" Z "u\n", "output bytes", outputBytes);
+    }
+    fprintf(file, "  %-14s %.0f\n", "ns/run",
+        runs ? seconds * 1e9 / runs : 0.0);
+    fprintf(file, "  %-14s %.0f\n", "runs/s",
+        seconds > 0 ? runs / seconds : 0.0);
+    if (inputRead)
+        fprintf(file, "  %-14s %.0f\n", "ns/line",
+            seconds * 1e9 / inputRead);
+}
+
+static double cpuSeconds()
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+// Compile all protocols of a file and report
+// compiled size, compile time and available handlers.
+static int checkFile(const char* filename, unsigned long repeat)
+{
+    StreamBuffer names;
+    const char* protocolname;
+    unsigned long i;
+    int errors = 0;
+
+    if (!StreamProtocolParser::listProtocols(filename, names))
+        return 1;
+    printf("%-24s %8s %10s  %s\n",
+        "protocol", "bytes", "us/compile", "handlers");
+    for (protocolname = names(); protocolname < names(names.length());
+        protocolname += strlen(protocolname) + 1)
+    {
+        StreamCheck stream(protocolname, NULL);
+        double start = cpuSeconds();
+        bool ok = true;
+        for (i = 0; ok && i < repeat; i++)
+            ok = stream.parse(filename, protocolname);
+        double seconds = cpuSeconds() - start;
+        if (!ok)
+        {
+            printf("%-24s %8s\n", protocolname, "ERROR");
+            errors++;
+            continue;
+        }
+        printf("%-24s %8" Z "u %10.1f  %s\n", protocolname,
+            stream.compiledSize(), seconds * 1e6 / repeat,
+            stream.handlerNames()());
+    }
+    return errors != 0;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [options] file [protocol [inputfile]]\n"
+        "  Without protocol: compile all protocols in file and report\n"
+        "  compiled size, compile time and exception handlers.\n"
+        "  With protocol: print the compiled protocol.\n"
+        "  With inputfile: run the protocol with input lines from inputfile\n"
+        "  as replies of the device until all input is used up.\n"
+        "  With -b bus: run the protocol on bus, e.g. replay:file.trace.\n"
+        "options:\n"
+        "  -p path   protocol search path (default: $STREAM_PROTOCOL_PATH)\n"
+        "  -n count  number of repetitions (default: 1)\n"
+        "  -e count  number of array elements (default: 1)\n"
+        "  -v value  value for output formats (default: 0)\n"
+        "  -b bus    run on this bus instead of reading inputfile\n"
+        "  -d level  set streamDebug\n",
+        name);
+}
+
+int main(int argc, char *argv[])
+{
+    const char* value = NULL;
+    const char* bus = NULL;
+    unsigned long repeat = 1;
+    unsigned long elements = 1;
+    unsigned long i;
+    int arg;
+
+    StreamProtocolParser::path = getenv("STREAM_PROTOCOL_PATH");
+    for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if (arg+1 >= argc || argv[arg][1] == 0 || argv[arg][2] != 0)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        switch (argv[arg][1])
+        {
+            case 'p':
+                StreamProtocolParser::path = argv[++arg];
+                break;
+            case 'n':
+                repeat = strtoul(argv[++arg], NULL, 0);
+                break;
+            case 'e':
+                elements = strtoul(argv[++arg], NULL, 0);
+                break;
+            case 'v':
+                value = argv[++arg];
+                break;
+            case 'b':
+                bus = argv[++arg];
+                break;
+            case 'd':
+                streamDebug = atoi(argv[++arg]);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (arg >= argc || argc - arg > 3 || !repeat || !elements ||
+        (bus && argc - arg != 2))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    streamDebugColored = 0;
+    streamMsgTimeStamped = 0;
+    if (argc - arg == 1)
+        return checkFile(argv[arg], repeat);
+
+    StreamCheck stream(argv[arg+1], value);
+    stream.setElements(elements);
+    if (!stream.parse(argv[arg], argv[arg+1]))
+        return 1;
+    if (bus)
+    {
+        if (!stream.attach(bus))
+            return 1;
+        double start = cpuSeconds();
+        for (i = 0; i < repeat; i++)
+        {
+            if (!stream.run()) return 1;
+            // report errors only once
+            streamError = 0;
+        }
+        double seconds = cpuSeconds() - start;
+        StreamBuffer status;
+        stream.printStatus(status);
+        printf("%s:\n", argv[arg+1]);
+        stream.printStatistics(stdout, seconds);
+        printf("  %-14s %s\n", "status", status());
+        StreamProtocolParser::free();
+        return 0;
+    }
+    if (argc - arg == 2)
+    {
+        stream.printProtocol(stdout);
+        return 0;
+    }
+    if (!readInputFile(argv[arg+2]))
+        return 1;
+
+    double start = cpuSeconds();
+    for (i = 0; i < repeat; i++)
+    {
+        inputPosition = 0;
+        inputRead = 0;
+        do {
+            size_t before = inputRead;
+            if (!stream.run()) return 1;
+            // do not loop forever on protocols without input
+            if (inputRead == before) break;
+        } while (inputRead < inputCount);
+        // report errors only once
+        streamError = 0;
+    }
+    double seconds = cpuSeconds() - start;
+    inputRead = inputCount * repeat;
+    printf("%s:\n", argv[arg+1]);
+    stream.printStatistics(stdout, seconds);
+    StreamProtocolParser::free();
+    return 0;
+}
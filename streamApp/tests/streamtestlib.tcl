@@ -41,7 +41,7 @@ proc receiveHandler {sock} {
 }
 
 proc startioc {} {
-    global debug records protocol startup port sock ioc testname env streamversion asynversion
+    global debug records protocol startup deviceconfig port sock ioc testname env streamversion asynversion
     set fd [open test.db w]
     puts $fd $records
     close $fd
@@ -65,7 +65,11 @@ proc startioc {} {
     puts $fd "var streamDebug 1"
     puts $fd "var streamError 1"
     puts $fd "epicsEnvSet STREAM_PROTOCOL_PATH ."
-    puts $fd "drvAsynIPPortConfigure device localhost:$port"
+    if [info exists deviceconfig] {
+        puts $fd [subst $deviceconfig]
+    } else {
+        puts $fd "drvAsynIPPortConfigure device localhost:$port"
+    }
     if [info exists startup] {
         puts $fd $startup
     }